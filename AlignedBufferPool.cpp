@@ -0,0 +1,81 @@
+#include "AlignedBufferPool.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+AlignedBufferPool::AlignedBufferPool(size_t count, size_t size, size_t align)
+    : memory(nullptr), buffer_count(std::max<size_t>(count, 1)), buffer_size((size + align - 1) / align * align),
+      alignment(align) {
+    void* region = nullptr;
+    if (posix_memalign(&region, alignment, buffer_count * buffer_size) != 0) {
+        throw std::bad_alloc();
+    }
+    memory = static_cast<char*>(region);
+    std::memset(memory, 0, buffer_count * buffer_size);
+
+    free_buffers.reserve(buffer_count);
+    for (size_t i = buffer_count; i > 0; i--) {
+        free_buffers.push_back(memory + (i - 1) * buffer_size);
+    }
+}
+
+AlignedBufferPool::~AlignedBufferPool() {
+    free(memory);
+}
+
+AlignedBufferPool::Lease::Lease(Lease&& other) noexcept : pool(other.pool), buffers(std::move(other.buffers)) {
+    other.pool = nullptr;
+    other.buffers.clear();
+}
+
+AlignedBufferPool::Lease& AlignedBufferPool::Lease::operator=(Lease&& other) noexcept {
+    if (this != &other) {
+        release();
+        pool = other.pool;
+        buffers = std::move(other.buffers);
+        other.pool = nullptr;
+        other.buffers.clear();
+    }
+    return *this;
+}
+
+void AlignedBufferPool::Lease::release() {
+    if (pool && !buffers.empty()) {
+        pool->giveBack(buffers);
+    }
+    buffers.clear();
+}
+
+AlignedBufferPool::Lease AlignedBufferPool::acquire(size_t count) {
+    count = std::min(count, buffer_count);
+    Lease lease;
+    lease.pool = this;
+    if (count == 0) {
+        return lease;
+    }
+
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    returned_cv.wait(lock, [this, count] { return free_buffers.size() >= count; });
+    lease.buffers.assign(free_buffers.end() - count, free_buffers.end());
+    free_buffers.resize(free_buffers.size() - count);
+    return lease;
+}
+
+void AlignedBufferPool::giveBack(std::vector<char*>& buffers) {
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        free_buffers.insert(free_buffers.end(), buffers.begin(), buffers.end());
+    }
+    returned_cv.notify_all();
+}
+
+bool AlignedBufferPool::isAligned(const void* pointer) const {
+    return reinterpret_cast<uintptr_t>(pointer) % alignment == 0;
+}
+
+size_t AlignedBufferPool::available() const {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    return free_buffers.size();
+}
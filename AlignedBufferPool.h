@@ -0,0 +1,61 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// Pool fijo de buffers alineados para E/S con O_DIRECT, que exige dirección, tamaño
+// y offset alineados. Toda la memoria se reserva al construirlo, así que el consumo no
+// crece con la carga: si no quedan buffers, acquire() espera a que otro hilo devuelva los suyos.
+class AlignedBufferPool
+{
+public:
+    AlignedBufferPool(size_t buffer_count, size_t buffer_size, size_t alignment);
+    ~AlignedBufferPool();
+
+    AlignedBufferPool(const AlignedBufferPool &) = delete;
+    AlignedBufferPool &operator=(const AlignedBufferPool &) = delete;
+
+    // Buffers prestados por el pool; se devuelven al destruir el préstamo
+    class Lease
+    {
+    public:
+        Lease() : pool(nullptr) {}
+        Lease(Lease &&other) noexcept;
+        Lease &operator=(Lease &&other) noexcept;
+        ~Lease() { release(); }
+
+        char *operator[](size_t i) const { return buffers[i]; }
+        size_t size() const { return buffers.size(); }
+
+        // Devolver los buffers antes de destruir el préstamo
+        void release();
+
+    private:
+        friend class AlignedBufferPool;
+        AlignedBufferPool *pool;
+        std::vector<char *> buffers;
+    };
+
+    // Tomar 'count' buffers de una vez (count <= capacity()). Se conceden todos o ninguno,
+    // para que dos hilos con préstamos parciales no se queden esperándose mutuamente.
+    Lease acquire(size_t count = 1);
+
+    // Indica si un puntero cumple la alineación exigida
+    bool isAligned(const void *pointer) const;
+
+    size_t capacity() const { return buffer_count; }
+    size_t bufferSize() const { return buffer_size; }
+    size_t available() const;
+
+private:
+    char *memory; // Región única con todos los buffers
+    size_t buffer_count;
+    size_t buffer_size;
+    size_t alignment;
+    std::vector<char *> free_buffers;
+    mutable std::mutex pool_mutex;
+    std::condition_variable returned_cv;
+
+    void giveBack(std::vector<char *> &buffers);
+};
@@ -0,0 +1,223 @@
+#include "AllocationGroups.h"
+#include <algorithm>
+
+AllocationGroups::AllocationGroups() : group_size(64), bit_count(0) {
+}
+
+void AllocationGroups::reset(size_t bits, size_t max_bits, size_t size) {
+    group_size = std::max<size_t>((size + 63) / 64 * 64, 64);
+    bit_count = bits;
+    size_t group_count = std::max<size_t>((std::max(bits, max_bits) + group_size - 1) / group_size, 1);
+    groups.clear();
+    for (size_t g = 0; g < group_count; g++) {
+        auto group = std::make_unique<Group>();
+        group->first = g * group_size;
+        group->map = BlockBitmap(lengthFor(g, bits));
+        groups.push_back(std::move(group));
+    }
+}
+
+size_t AllocationGroups::lengthFor(size_t group, size_t bits) const {
+    size_t first = group * group_size;
+    return bits > first ? std::min(group_size, bits - first) : 0;
+}
+
+size_t AllocationGroups::count() const {
+    size_t total = 0;
+    for (const auto& group : groups) {
+        total += group->used.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+size_t AllocationGroups::activeGroups() const {
+    return std::max<size_t>((bit_count + group_size - 1) / group_size, 1);
+}
+
+bool AllocationGroups::test(size_t index) const {
+    if (index >= bit_count) {
+        return false;
+    }
+    const Group& group = *groups[index / group_size];
+    std::lock_guard<std::mutex> lock(group.mutex);
+    return group.map.test(index - group.first);
+}
+
+bool AllocationGroups::set(size_t index) {
+    if (index >= bit_count) {
+        return false;
+    }
+    Group& group = *groups[index / group_size];
+    std::lock_guard<std::mutex> lock(group.mutex);
+    if (!group.map.set(index - group.first)) {
+        return false;
+    }
+    group.used.store(group.map.count(), std::memory_order_relaxed);
+    markDirtyLocked(group, index - group.first, 1);
+    return true;
+}
+
+bool AllocationGroups::clear(size_t index) {
+    if (index >= bit_count) {
+        return false;
+    }
+    Group& group = *groups[index / group_size];
+    std::lock_guard<std::mutex> lock(group.mutex);
+    if (!group.map.clear(index - group.first)) {
+        return false;
+    }
+    group.used.store(group.map.count(), std::memory_order_relaxed);
+    markDirtyLocked(group, index - group.first, 1);
+    return true;
+}
+
+void AllocationGroups::takeLocked(Group& group, size_t local, size_t length) {
+    for (size_t i = local; i < local + length; i++) {
+        group.map.set(i);
+    }
+    group.used.store(group.map.count(), std::memory_order_relaxed);
+    markDirtyLocked(group, local, length);
+}
+
+void AllocationGroups::markDirtyLocked(Group& group, size_t local, size_t length) {
+    if (length == 0) {
+        return;
+    }
+    if (group.dirty_words.empty()) {
+        group.dirty_words.assign((group_size / 64 + 63) / 64, 0);
+    }
+    for (size_t word = local / 64; word <= (local + length - 1) / 64; word++) {
+        group.dirty_words[word / 64] |= uint64_t(1) << (word % 64);
+    }
+    group.dirty = true;
+}
+
+size_t AllocationGroups::allocateOne(size_t group_index) {
+    Group& group = *groups[group_index];
+    std::lock_guard<std::mutex> lock(group.mutex);
+    size_t local = group.map.findFirstClear();
+    if (local == npos) {
+        return npos;
+    }
+    takeLocked(group, local, 1);
+    return group.first + local;
+}
+
+size_t AllocationGroups::allocateRun(size_t group_index, size_t count, size_t from, size_t max_probes) {
+    Group& group = *groups[group_index];
+    std::lock_guard<std::mutex> lock(group.mutex);
+    size_t length = group.map.size();
+    if (count == 0 || group.map.size() - group.map.count() < count) {
+        return npos;
+    }
+
+    size_t local_from = (from >= group.first && from - group.first < length) ? from - group.first : 0;
+    size_t probes = 0;
+    for (size_t start : {local_from, static_cast<size_t>(0)}) {
+        size_t limit = (start == local_from) ? length : local_from;
+        size_t pos = group.map.findFirstClear(start);
+        while (pos != npos && pos < limit && probes < max_probes) {
+            size_t run = group.map.clearRunLength(pos, count);
+            if (run == count) {
+                takeLocked(group, pos, count);
+                return group.first + pos;
+            }
+            probes++;
+            pos = group.map.findFirstClear(pos + run);
+        }
+        if (local_from == 0) {
+            break;
+        }
+    }
+    return npos;
+}
+
+size_t AllocationGroups::allocatePartial(size_t group_index, size_t max_count, size_t from, size_t& start) {
+    Group& group = *groups[group_index];
+    std::lock_guard<std::mutex> lock(group.mutex);
+    size_t length = group.map.size();
+    size_t local_from = (from >= group.first && from - group.first < length) ? from - group.first : 0;
+    size_t pos = group.map.findFirstClear(local_from);
+    if (pos == npos) {
+        pos = group.map.findFirstClear(0);
+    }
+    if (pos == npos || max_count == 0) {
+        return 0;
+    }
+    size_t run = group.map.clearRunLength(pos, max_count);
+    takeLocked(group, pos, run);
+    start = group.first + pos;
+    return run;
+}
+
+void AllocationGroups::resize(size_t new_bit_count) {
+    // Solo cambian los grupos que cubren el rango entre el tamaño anterior y el nuevo
+    size_t old_bits = bit_count;
+    size_t first_group = std::min(old_bits, new_bit_count) / group_size;
+    size_t last_group = (std::max(old_bits, new_bit_count) + group_size - 1) / group_size;
+    for (size_t g = first_group; g < std::min(last_group, groups.size()); g++) {
+        Group& group = *groups[g];
+        std::lock_guard<std::mutex> lock(group.mutex);
+        size_t length = lengthFor(g, new_bit_count);
+        if (group.map.size() != length) {
+            group.map.resize(length);
+            group.used.store(group.map.count(), std::memory_order_relaxed);
+            markDirtyLocked(group, 0, group_size);
+        }
+    }
+    bit_count = new_bit_count;
+}
+
+void AllocationGroups::assignWords(const uint64_t* source, size_t count) {
+    size_t words_per_group = group_size / 64;
+    for (size_t g = 0; g < groups.size(); g++) {
+        Group& group = *groups[g];
+        std::lock_guard<std::mutex> lock(group.mutex);
+        size_t first_word = g * words_per_group;
+        if (first_word < count) {
+            group.map.assignWords(source + first_word, std::min(words_per_group, count - first_word));
+            group.used.store(group.map.count(), std::memory_order_relaxed);
+        }
+    }
+}
+
+AllocationGroups::DirtyWords AllocationGroups::takeDirtyWords() {
+    DirtyWords dirty;
+    size_t words_per_group = group_size / 64;
+    for (size_t g = 0; g < groups.size(); g++) {
+        Group& group = *groups[g];
+        std::lock_guard<std::mutex> lock(group.mutex);
+        if (!group.dirty) {
+            continue;
+        }
+        // Las palabras más allá del grupo actual (aún sin crecer) no existen en el mapa
+        const uint64_t* words = group.map.words();
+        size_t word_count = group.map.wordCount();
+        size_t first_word = g * words_per_group;
+        for (size_t i = 0; i < group.dirty_words.size(); i++) {
+            uint64_t mask = group.dirty_words[i];
+            group.dirty_words[i] = 0;
+            while (mask) {
+                size_t word = i * 64 + __builtin_ctzll(mask);
+                mask &= mask - 1;
+                if (word >= word_count) {
+                    continue;
+                }
+                if (!dirty.empty() && dirty.back().first + dirty.back().second.size() == first_word + word) {
+                    dirty.back().second.push_back(words[word]);
+                } else {
+                    dirty.push_back({first_word + word, {words[word]}});
+                }
+            }
+        }
+        group.dirty = false;
+    }
+    return dirty;
+}
+
+void AllocationGroups::markAllDirty() {
+    for (auto& group : groups) {
+        std::lock_guard<std::mutex> lock(group->mutex);
+        markDirtyLocked(*group, 0, group_size);
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include "BlockBitmap.h"
+
+// Mapa de bloques libres/usados repartido en grupos de asignación de tamaño fijo.
+// Cada grupo tiene su propio mapa jerárquico y su propio mutex, de modo que hilos que
+// reservan en grupos distintos no compiten entre sí. Los grupos se crean para todo el
+// rango hasta el tope de crecimiento (los que aún no existen tienen longitud 0), así que
+// la lista de grupos no cambia nunca y se puede recorrer sin un cerrojo global.
+// El tamaño de grupo es múltiplo de 64: cada palabra del formato persistente pertenece a un solo grupo.
+class AllocationGroups
+{
+public:
+    static constexpr size_t npos = BlockBitmap::npos;
+
+    AllocationGroups();
+
+    // Rehacer el mapa con 'bit_count' bloques libres, en grupos de 'group_size' bloques hasta 'max_bits'
+    void reset(size_t bit_count, size_t max_bits, size_t group_size);
+
+    // Número de bits (bloques) y de bits usados (suma de los contadores de cada grupo)
+    size_t size() const { return bit_count; }
+    size_t count() const;
+
+    // Grupos con algún bloque y tamaño de cada uno
+    size_t activeGroups() const;
+    size_t groupSize() const { return group_size; }
+    size_t groupOf(size_t index) const { return index / group_size; }
+
+    // Consultar y cambiar un bit (cada llamada toma el mutex de su grupo)
+    bool test(size_t index) const;
+    bool set(size_t index);
+    bool clear(size_t index);
+
+    // Reservar el primer bloque libre del grupo; npos si está lleno
+    size_t allocateOne(size_t group);
+
+    // Reservar una racha de exactamente 'count' bloques dentro del grupo, buscando desde 'from'
+    // (si cae en el grupo) hasta el final y después desde el principio. Se examinan como mucho
+    // 'max_probes' rachas. Devuelve el primer bloque o npos.
+    size_t allocateRun(size_t group, size_t count, size_t from, size_t max_probes);
+
+    // Reservar la primera racha libre del grupo a partir de 'from' (o del principio), de hasta
+    // 'max_count' bloques. Devuelve su longitud (0 si el grupo está lleno) y su inicio en 'start'.
+    size_t allocatePartial(size_t group, size_t max_count, size_t from, size_t &start);
+
+    // Cambiar el número de bits (crecimiento del almacén); los nuevos quedan libres
+    void resize(size_t new_bit_count);
+
+    // Cargar el formato persistente (bit i de la palabra w = bloque w*64+i)
+    void assignWords(const uint64_t *source, size_t count);
+
+    // Palabras modificadas desde la última llamada, agrupadas en rachas contiguas:
+    // (primera palabra, contenido). Cada grupo apunta qué palabras cambió, así que un bit
+    // suelto cuesta una palabra y no el grupo entero.
+    using DirtyWords = std::vector<std::pair<size_t, std::vector<uint64_t>>>;
+    DirtyWords takeDirtyWords();
+    void markAllDirty();
+
+private:
+    struct Group
+    {
+        mutable std::mutex mutex;
+        BlockBitmap map;             // Índices locales: bloque = first + índice
+        size_t first = 0;
+        std::atomic<size_t> used{0}; // Copia de map.count() legible sin el mutex
+        std::vector<uint64_t> dirty_words; // Bit w = palabra local w modificada desde la última escritura
+        bool dirty = false;
+    };
+
+    size_t group_size;
+    std::atomic<size_t> bit_count;
+    std::vector<std::unique_ptr<Group>> groups;
+
+    // Longitud de un grupo con 'bits' bloques en total
+    size_t lengthFor(size_t group, size_t bits) const;
+
+    // Marcar [local, local + length) como usado en un grupo ya bloqueado
+    void takeLocked(Group &group, size_t local, size_t length);
+
+    // Apuntar como modificadas las palabras que cubren los bits [local, local + length)
+    void markDirtyLocked(Group &group, size_t local, size_t length);
+};
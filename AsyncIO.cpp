@@ -0,0 +1,283 @@
+#include "AsyncIO.h"
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+
+AsyncIO::AsyncIO(int fd, size_t max_requests, size_t worker_threads)
+    : file_descriptor(fd), max_in_flight(std::max<size_t>(max_requests, 1)), in_flight(0), stopping(false),
+      ring_fd(-1), ring_entries(0), sq_ring(nullptr), cq_ring(nullptr), sq_ring_size(0), cq_ring_size(0),
+      sqes(nullptr), sqes_size(0), sq_head(nullptr), sq_tail(nullptr), sq_mask(nullptr), sq_array(nullptr),
+      cq_head(nullptr), cq_tail(nullptr), cq_mask(nullptr), cqes(nullptr) {
+
+    if (setupRing(static_cast<unsigned>(max_in_flight))) {
+        threads.emplace_back(&AsyncIO::ringLoop, this);
+        return;
+    }
+
+    // Sin io_uring (kernel antiguo, seccomp, etc.): pool de hilos
+    for (size_t i = 0; i < std::max<size_t>(worker_threads, 1); i++) {
+        threads.emplace_back(&AsyncIO::workerLoop, this);
+    }
+}
+
+AsyncIO::~AsyncIO() {
+    drain();
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    queue_cv.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    teardownRing();
+}
+
+bool AsyncIO::setupRing(unsigned entries) {
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) {
+        return false;
+    }
+    ring_fd = fd;
+    ring_entries = params.sq_entries;
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+    }
+
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        sq_ring = nullptr;
+        teardownRing();
+        return false;
+    }
+
+    if (single_mmap) {
+        cq_ring = sq_ring;
+    } else {
+        cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) {
+            cq_ring = nullptr;
+            teardownRing();
+            return false;
+        }
+    }
+
+    sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqe_region = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ring_fd, IORING_OFF_SQES);
+    if (sqe_region == MAP_FAILED) {
+        teardownRing();
+        return false;
+    }
+    sqes = static_cast<struct io_uring_sqe*>(sqe_region);
+
+    char* sq = static_cast<char*>(sq_ring);
+    char* cq = static_cast<char*>(cq_ring);
+    sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+void AsyncIO::teardownRing() {
+    if (sqes) {
+        munmap(sqes, sqes_size);
+        sqes = nullptr;
+    }
+    if (cq_ring && cq_ring != sq_ring) {
+        munmap(cq_ring, cq_ring_size);
+    }
+    if (sq_ring) {
+        munmap(sq_ring, sq_ring_size);
+    }
+    sq_ring = cq_ring = nullptr;
+    if (ring_fd >= 0) {
+        close(ring_fd);
+        ring_fd = -1;
+    }
+}
+
+void AsyncIO::submit(Operation op, std::vector<struct iovec> segments, off_t offset, Callback callback) {
+    auto* request = new Request{op, std::move(segments), offset, 0, std::move(callback)};
+    for (const auto& segment : request->segments) {
+        request->length += segment.iov_len;
+    }
+
+    {
+        // Respetar el límite de peticiones en vuelo
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        slots_cv.wait(lock, [this] { return in_flight < max_in_flight; });
+        in_flight++;
+        submission_queue.push_back(request);
+    }
+    queue_cv.notify_one();
+}
+
+std::future<ssize_t> AsyncIO::submit(Operation op, std::vector<struct iovec> segments, off_t offset) {
+    auto promise = std::make_shared<std::promise<ssize_t>>();
+    std::future<ssize_t> result = promise->get_future();
+    submit(op, std::move(segments), offset, [promise](ssize_t bytes) { promise->set_value(bytes); });
+    return result;
+}
+
+void AsyncIO::drain() {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    slots_cv.wait(lock, [this] { return in_flight == 0; });
+}
+
+size_t AsyncIO::getInFlight() const {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    return in_flight;
+}
+
+void AsyncIO::ringLoop() {
+    size_t in_ring = 0;
+    while (true) {
+        // 1. Pasar peticiones de la cola de envío al anillo
+        std::vector<Request*> batch;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            if (in_ring == 0) {
+                queue_cv.wait(lock, [this] { return stopping || !submission_queue.empty(); });
+                if (submission_queue.empty()) {
+                    return; // parada sin trabajo pendiente
+                }
+            }
+            while (!submission_queue.empty() && in_ring + batch.size() < ring_entries) {
+                batch.push_back(submission_queue.front());
+                submission_queue.pop_front();
+            }
+        }
+
+        unsigned tail = *sq_tail;
+        for (Request* request : batch) {
+            unsigned index = tail & *sq_mask;
+            struct io_uring_sqe* sqe = &sqes[index];
+            std::memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = request->op == Operation::Write ? IORING_OP_WRITEV : IORING_OP_READV;
+            sqe->fd = file_descriptor;
+            sqe->addr = reinterpret_cast<unsigned long>(request->segments.data());
+            sqe->len = static_cast<unsigned>(request->segments.size());
+            sqe->off = static_cast<unsigned long long>(request->offset);
+            sqe->user_data = reinterpret_cast<unsigned long long>(request);
+            sq_array[index] = index;
+            tail++;
+        }
+        __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+        in_ring += batch.size();
+
+        // 2. Enviar; si no había nada nuevo, esperar al menos un completado
+        unsigned min_complete = batch.empty() ? 1 : 0;
+        unsigned to_submit = static_cast<unsigned>(batch.size());
+        while (true) {
+            long ret = syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete,
+                               IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (ret >= 0) {
+                to_submit -= std::min<unsigned>(to_submit, static_cast<unsigned>(ret));
+            }
+            if ((ret >= 0 && to_submit == 0) || (ret < 0 && errno != EINTR && errno != EAGAIN)) {
+                break;
+            }
+        }
+
+        // 3. Recoger la cola de completado
+        unsigned head = *cq_head;
+        while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe* cqe = &cqes[head & *cq_mask];
+            Request* request = reinterpret_cast<Request*>(cqe->user_data);
+            ssize_t result = cqe->res;
+            head++;
+            __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+            in_ring--;
+            complete(request, result);
+        }
+    }
+}
+
+void AsyncIO::workerLoop() {
+    while (true) {
+        Request* request;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_cv.wait(lock, [this] { return stopping || !submission_queue.empty(); });
+            if (submission_queue.empty()) {
+                return;
+            }
+            request = submission_queue.front();
+            submission_queue.pop_front();
+        }
+
+        int count = static_cast<int>(request->segments.size());
+        ssize_t result = request->op == Operation::Write
+                             ? pwritev(file_descriptor, request->segments.data(), count, request->offset)
+                             : preadv(file_descriptor, request->segments.data(), count, request->offset);
+        complete(request, result < 0 ? -errno : result);
+    }
+}
+
+void AsyncIO::complete(Request* request, ssize_t result) {
+    // Transferencia parcial: completar el resto de forma síncrona
+    if (result >= 0 && static_cast<size_t>(result) < request->length) {
+        size_t done = static_cast<size_t>(result);
+        size_t skipped = 0;
+        for (const auto& segment : request->segments) {
+            if (skipped + segment.iov_len <= done) {
+                skipped += segment.iov_len;
+                continue;
+            }
+            size_t start = done > skipped ? done - skipped : 0;
+            char* base = static_cast<char*>(segment.iov_base) + start;
+            size_t remaining = segment.iov_len - start;
+            off_t position = request->offset + skipped + start;
+            while (remaining > 0) {
+                ssize_t n = request->op == Operation::Write ? pwrite(file_descriptor, base, remaining, position)
+                                                            : pread(file_descriptor, base, remaining, position);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    break;
+                }
+                base += n;
+                position += n;
+                remaining -= n;
+                done += n;
+            }
+            skipped += segment.iov_len;
+            if (remaining > 0) {
+                break;
+            }
+        }
+        result = static_cast<ssize_t>(done);
+    }
+
+    if (request->callback) {
+        request->callback(result);
+    }
+    delete request;
+
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        in_flight--;
+    }
+    slots_cv.notify_all();
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Motor de E/S asíncrona sobre un descriptor de archivo.
+// Las peticiones entran en una cola de envío y se completan con un callback
+// (ejecutado en el hilo de E/S) o a través de un std::future.
+// Usa io_uring si el kernel lo permite; si no, un pool de hilos con preadv/pwritev.
+// submit() bloquea mientras haya max_in_flight peticiones sin completar.
+class AsyncIO
+{
+public:
+    enum class Operation
+    {
+        Read,
+        Write
+    };
+
+    // Resultado de una petición: bytes transferidos o -errno
+    using Callback = std::function<void(ssize_t result)>;
+
+    AsyncIO(int file_descriptor, size_t max_in_flight = 64, size_t worker_threads = 4);
+    ~AsyncIO();
+
+    AsyncIO(const AsyncIO &) = delete;
+    AsyncIO &operator=(const AsyncIO &) = delete;
+
+    // Encolar una lectura/escritura de los segmentos a partir de 'offset'.
+    // Los buffers deben seguir vivos hasta que la petición se complete.
+    void submit(Operation op, std::vector<struct iovec> segments, off_t offset, Callback callback);
+    std::future<ssize_t> submit(Operation op, std::vector<struct iovec> segments, off_t offset);
+
+    // Esperar a que se completen todas las peticiones enviadas
+    void drain();
+
+    // Indica si las peticiones se atienden con io_uring
+    bool usingIoUring() const { return ring_fd >= 0; }
+
+    // Número de peticiones enviadas y aún no completadas
+    size_t getInFlight() const;
+
+private:
+    struct Request
+    {
+        Operation op;
+        std::vector<struct iovec> segments;
+        off_t offset;
+        size_t length;
+        Callback callback;
+    };
+
+    int file_descriptor;
+    size_t max_in_flight;
+    size_t in_flight;
+    bool stopping;
+
+    mutable std::mutex queue_mutex;
+    std::condition_variable queue_cv; // Hay peticiones en la cola de envío (o parada)
+    std::condition_variable slots_cv; // Se completó alguna petición
+    std::deque<Request *> submission_queue;
+    std::vector<std::thread> threads;
+
+    // Estado de io_uring (ring_fd < 0 si no está disponible)
+    int ring_fd;
+    unsigned ring_entries;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    // Crear y mapear el anillo; devuelve false si el kernel no lo permite
+    bool setupRing(unsigned entries);
+    void teardownRing();
+
+    // Hilo que envía peticiones al anillo y recoge la cola de completado
+    void ringLoop();
+
+    // Hilos del pool de respaldo
+    void workerLoop();
+
+    // Terminar una transferencia parcial de forma síncrona, invocar el callback y liberar el hueco
+    void complete(Request *request, ssize_t result);
+};
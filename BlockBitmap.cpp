@@ -0,0 +1,196 @@
+#include "BlockBitmap.h"
+#include <algorithm>
+
+namespace {
+constexpr uint64_t FULL_WORD = ~static_cast<uint64_t>(0);
+
+// Palabras necesarias para representar 'bits' bits
+size_t wordsFor(size_t bits) {
+    return (bits + 63) / 64;
+}
+
+// Máscara con los bits de relleno (posiciones >= bits en la última palabra)
+uint64_t paddingMask(size_t bits) {
+    size_t used = bits % 64;
+    return used == 0 ? 0 : (FULL_WORD << used);
+}
+}
+
+BlockBitmap::BlockBitmap(size_t bits) : bit_count(bits), set_count(0) {
+    if (bit_count == 0) {
+        return;
+    }
+
+    // Construir niveles hasta que el superior quepa en una sola palabra.
+    // Los bits de relleno se marcan como "usados/llenos" para que nunca se devuelvan.
+    size_t level_bits = bit_count;
+    while (true) {
+        std::vector<uint64_t> level(wordsFor(level_bits), 0);
+        level.back() |= paddingMask(level_bits);
+        levels.push_back(std::move(level));
+        if (levels.back().size() == 1) {
+            break;
+        }
+        level_bits = levels.back().size();
+    }
+}
+
+void BlockBitmap::assignWords(const uint64_t* source, size_t count) {
+    if (levels.empty()) {
+        return;
+    }
+    std::vector<uint64_t>& bits = levels[0];
+    std::fill(bits.begin(), bits.end(), 0);
+    std::copy(source, source + std::min(count, bits.size()), bits.begin());
+    rebuildSummaries();
+}
+
+void BlockBitmap::resize(size_t new_bit_count) {
+    std::vector<uint64_t> bits = levels.empty() ? std::vector<uint64_t>() : levels[0];
+    if (!bits.empty()) {
+        // Los bits de relleno de la última palabra pasan a ser bloques reales libres
+        bits.back() &= ~paddingMask(bit_count);
+    }
+    *this = BlockBitmap(new_bit_count);
+    assignWords(bits.data(), bits.size());
+}
+
+void BlockBitmap::rebuildSummaries() {
+    // Restaurar el relleno del nivel 0 y contar bits usados reales
+    levels[0].back() |= paddingMask(bit_count);
+    set_count = 0;
+    for (uint64_t word : levels[0]) {
+        set_count += __builtin_popcountll(word);
+    }
+    set_count -= __builtin_popcountll(paddingMask(bit_count));
+
+    // Cada nivel superior marca las palabras llenas del nivel inferior
+    for (size_t l = 1; l < levels.size(); l++) {
+        std::vector<uint64_t>& level = levels[l];
+        std::fill(level.begin(), level.end(), 0);
+        level.back() |= paddingMask(levels[l - 1].size());
+        for (size_t w = 0; w < levels[l - 1].size(); w++) {
+            if (levels[l - 1][w] == FULL_WORD) {
+                level[w / 64] |= static_cast<uint64_t>(1) << (w % 64);
+            }
+        }
+    }
+}
+
+bool BlockBitmap::test(size_t index) const {
+    if (index >= bit_count) {
+        return false;
+    }
+    return (levels[0][index / 64] >> (index % 64)) & 1;
+}
+
+bool BlockBitmap::set(size_t index) {
+    if (index >= bit_count || test(index)) {
+        return false;
+    }
+
+    size_t word = index / 64;
+    levels[0][word] |= static_cast<uint64_t>(1) << (index % 64);
+    set_count++;
+
+    if (levels[0][word] == FULL_WORD) {
+        propagateFull(0, word);
+    }
+    return true;
+}
+
+bool BlockBitmap::clear(size_t index) {
+    if (index >= bit_count || !test(index)) {
+        return false;
+    }
+
+    size_t word = index / 64;
+    bool was_full = levels[0][word] == FULL_WORD;
+    levels[0][word] &= ~(static_cast<uint64_t>(1) << (index % 64));
+    set_count--;
+
+    if (was_full) {
+        propagateNotFull(0, word);
+    }
+    return true;
+}
+
+void BlockBitmap::propagateFull(size_t level, size_t word) {
+    // Subir mientras cada palabra padre quede llena
+    while (level + 1 < levels.size()) {
+        uint64_t &parent = levels[level + 1][word / 64];
+        parent |= static_cast<uint64_t>(1) << (word % 64);
+        if (parent != FULL_WORD) {
+            break;
+        }
+        level++;
+        word /= 64;
+    }
+}
+
+void BlockBitmap::propagateNotFull(size_t level, size_t word) {
+    // Subir mientras la palabra padre estuviera llena antes del cambio
+    while (level + 1 < levels.size()) {
+        uint64_t &parent = levels[level + 1][word / 64];
+        bool parent_was_full = parent == FULL_WORD;
+        parent &= ~(static_cast<uint64_t>(1) << (word % 64));
+        if (!parent_was_full) {
+            break;
+        }
+        level++;
+        word /= 64;
+    }
+}
+
+size_t BlockBitmap::findFirstClear(size_t from) const {
+    if (from >= bit_count) {
+        return npos;
+    }
+
+    // Ascender: buscar en la palabra actual un bit libre en o después de 'pos';
+    // si no hay, pasar a la siguiente palabra consultando el nivel superior
+    size_t level = 0;
+    size_t pos = from;
+    while (true) {
+        if (level == levels.size()) {
+            return npos;
+        }
+        size_t word = pos / 64;
+        if (word >= levels[level].size()) {
+            return npos;
+        }
+        uint64_t candidates = ~levels[level][word] & (FULL_WORD << (pos % 64));
+        if (candidates) {
+            pos = word * 64 + __builtin_ctzll(candidates);
+            break;
+        }
+        pos = word + 1;
+        level++;
+    }
+
+    // Descender: cada bit libre del nivel k apunta a una palabra no llena del nivel k-1
+    while (level > 0) {
+        level--;
+        pos = pos * 64 + __builtin_ctzll(~levels[level][pos]);
+    }
+
+    return pos < bit_count ? pos : npos;
+}
+
+size_t BlockBitmap::clearRunLength(size_t from, size_t max_length) const {
+    size_t length = 0;
+    size_t pos = from;
+    while (length < max_length && pos < bit_count) {
+        // Bits ocupados en la palabra a partir de 'pos'
+        uint64_t busy = levels[0][pos / 64] >> (pos % 64);
+        size_t available = 64 - pos % 64;
+        size_t run = busy ? __builtin_ctzll(busy) : available;
+        length += run;
+        pos += run;
+        if (run < available) {
+            break;
+        }
+    }
+    // Los bits de relleno están marcados, así que la racha nunca pasa de bit_count
+    return std::min(length, max_length);
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Mapa de bits jerárquico de bloques libres/usados.
+// Nivel 0: un bit por bloque (1 = usado).
+// Nivel k > 0: un bit por palabra del nivel k-1 (1 = palabra completamente llena),
+// de modo que buscar un bloque libre cuesta O(log64 N) búsquedas de palabra.
+class BlockBitmap
+{
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    explicit BlockBitmap(size_t bit_count = 0);
+
+    // Número de bits (bloques) representados
+    size_t size() const { return bit_count; }
+
+    // Número de bits marcados como usados (se mantiene incrementalmente)
+    size_t count() const { return set_count; }
+
+    // Consultar el estado de un bit
+    bool test(size_t index) const;
+
+    // Marcar un bit como usado; devuelve true si cambió de estado
+    bool set(size_t index);
+
+    // Marcar un bit como libre; devuelve true si cambió de estado
+    bool clear(size_t index);
+
+    // Primer bit libre a partir de 'from' (npos si no hay ninguno)
+    size_t findFirstClear(size_t from = 0) const;
+
+    // Palabras del nivel 0 (formato persistente: bit i de la palabra w = bloque w*64+i)
+    const uint64_t *words() const { return levels.empty() ? nullptr : levels[0].data(); }
+    size_t wordCount() const { return levels.empty() ? 0 : levels[0].size(); }
+
+    // Cargar el nivel 0 desde palabras persistidas y reconstruir los niveles de resumen
+    void assignWords(const uint64_t *source, size_t count);
+
+    // Cambiar el número de bits conservando el estado de los existentes (los nuevos quedan libres)
+    void resize(size_t new_bit_count);
+
+    // Longitud (acotada por max_length) de la racha de bits libres que empieza en 'from'
+    size_t clearRunLength(size_t from, size_t max_length) const;
+
+private:
+    size_t bit_count;
+    size_t set_count;
+    std::vector<std::vector<uint64_t>> levels; // levels[0] = bits de bloques
+
+    // Recalcular los niveles de resumen y el contador a partir del nivel 0
+    void rebuildSummaries();
+
+    // Marcar (o desmarcar) en el nivel superior que la palabra 'word' del nivel 'level' está llena
+    void propagateFull(size_t level, size_t word);
+    void propagateNotFull(size_t level, size_t word);
+};
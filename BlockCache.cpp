@@ -0,0 +1,162 @@
+#include "BlockCache.h"
+#include <algorithm>
+#include <cstring>
+
+BlockCache::BlockCache(size_t capacity_blocks, size_t size)
+    : capacity(capacity_blocks), block_size(size), target_t1(0),
+      storage(capacity_blocks * size), hits(0), misses(0), evictions(0) {
+    free_slots.reserve(capacity);
+    for (size_t slot = capacity; slot > 0; slot--) {
+        free_slots.push_back(slot - 1);
+    }
+}
+
+std::list<size_t>& BlockCache::listFor(ListId id) {
+    switch (id) {
+    case ListId::T1:
+        return t1;
+    case ListId::T2:
+        return t2;
+    case ListId::B1:
+        return b1;
+    default:
+        return b2;
+    }
+}
+
+void BlockCache::moveTo(size_t block_index, Entry& entry, ListId target) {
+    listFor(entry.list).erase(entry.position);
+    std::list<size_t>& destination = listFor(target);
+    destination.push_front(block_index);
+    entry.list = target;
+    entry.position = destination.begin();
+}
+
+bool BlockCache::lookup(size_t block_index, void* buffer, size_t size) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto it = entries.find(block_index);
+    if (it == entries.end() || it->second.list == ListId::B1 || it->second.list == ListId::B2) {
+        misses++;
+        return false;
+    }
+
+    // Acierto: el bloque pasa a T2 (usado más de una vez)
+    Entry& entry = it->second;
+    std::memcpy(buffer, storage.data() + entry.slot * block_size, std::min(size, block_size));
+    moveTo(block_index, entry, ListId::T2);
+    hits++;
+    return true;
+}
+
+void BlockCache::insert(size_t block_index, const void* data) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    if (capacity == 0) {
+        return;
+    }
+
+    auto it = entries.find(block_index);
+    if (it != entries.end() && (it->second.list == ListId::T1 || it->second.list == ListId::T2)) {
+        // Ya residente (otro hilo lo insertó antes): solo actualizar el contenido
+        std::memcpy(storage.data() + it->second.slot * block_size, data, block_size);
+        return;
+    }
+
+    if (it != entries.end()) {
+        // Acierto fantasma: adaptar 'p' hacia la lista que lo habría conservado
+        bool in_b2 = it->second.list == ListId::B2;
+        if (!in_b2) {
+            size_t delta = std::max<size_t>(b2.size() / std::max<size_t>(b1.size(), 1), 1);
+            target_t1 = std::min(capacity, target_t1 + delta);
+        } else {
+            size_t delta = std::max<size_t>(b1.size() / std::max<size_t>(b2.size(), 1), 1);
+            target_t1 = target_t1 > delta ? target_t1 - delta : 0;
+        }
+        if (free_slots.empty()) {
+            replace(in_b2);
+        }
+        Entry& entry = it->second;
+        moveTo(block_index, entry, ListId::T2);
+        entry.slot = free_slots.back();
+        free_slots.pop_back();
+        std::memcpy(storage.data() + entry.slot * block_size, data, block_size);
+        return;
+    }
+
+    // Bloque nuevo: mantener |T1| + |B1| <= c y el directorio completo <= 2c
+    if (t1.size() + b1.size() >= capacity) {
+        if (!b1.empty()) {
+            dropGhost(ListId::B1);
+            if (free_slots.empty()) {
+                replace(false);
+            }
+        } else {
+            // T1 ocupa toda la caché: expulsar su bloque menos reciente sin dejar rastro
+            size_t victim = t1.back();
+            free_slots.push_back(entries[victim].slot);
+            t1.pop_back();
+            entries.erase(victim);
+            evictions++;
+        }
+    } else {
+        size_t directory = t1.size() + t2.size() + b1.size() + b2.size();
+        if (directory >= 2 * capacity && !b2.empty()) {
+            dropGhost(ListId::B2);
+        }
+        if (free_slots.empty()) {
+            replace(false);
+        }
+    }
+
+    Entry entry;
+    entry.list = ListId::T1;
+    t1.push_front(block_index);
+    entry.position = t1.begin();
+    entry.slot = free_slots.back();
+    free_slots.pop_back();
+    std::memcpy(storage.data() + entry.slot * block_size, data, block_size);
+    entries[block_index] = entry;
+}
+
+void BlockCache::replace(bool hit_in_b2) {
+    bool from_t1 = !t1.empty() && (t1.size() > target_t1 || (hit_in_b2 && t1.size() == target_t1) || t2.empty());
+    std::list<size_t>& source = from_t1 ? t1 : t2;
+    if (source.empty()) {
+        return;
+    }
+
+    size_t victim = source.back();
+    Entry& entry = entries[victim];
+    free_slots.push_back(entry.slot);
+    moveTo(victim, entry, from_t1 ? ListId::B1 : ListId::B2);
+    evictions++;
+}
+
+void BlockCache::dropGhost(ListId id) {
+    std::list<size_t>& ghosts = listFor(id);
+    entries.erase(ghosts.back());
+    ghosts.pop_back();
+}
+
+void BlockCache::invalidate(size_t block_index) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto it = entries.find(block_index);
+    if (it == entries.end()) {
+        return;
+    }
+    if (it->second.list == ListId::T1 || it->second.list == ListId::T2) {
+        free_slots.push_back(it->second.slot);
+    }
+    listFor(it->second.list).erase(it->second.position);
+    entries.erase(it);
+}
+
+BlockCache::Stats BlockCache::getStats() const {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    Stats stats;
+    stats.capacity_blocks = capacity;
+    stats.resident_blocks = capacity - free_slots.size();
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.evictions = evictions;
+    return stats;
+}
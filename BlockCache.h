@@ -0,0 +1,75 @@
+#pragma once
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Caché de bloques físicos en memoria con política ARC (Adaptive Replacement Cache).
+// T1 guarda bloques vistos una vez y T2 los vistos varias veces; B1/B2 son listas
+// "fantasma" (solo índices) que ajustan el reparto entre ambas. Un recorrido secuencial
+// solo pasa por T1, así que no expulsa los bloques compartidos que viven en T2.
+class BlockCache
+{
+public:
+    BlockCache(size_t capacity_blocks, size_t block_size);
+
+    // Copiar el bloque a 'buffer' si está en caché (cuenta acierto o fallo)
+    bool lookup(size_t block_index, void *buffer, size_t size);
+
+    // Insertar un bloque completo leído del disco
+    void insert(size_t block_index, const void *data);
+
+    // Descartar un bloque (escrito o liberado)
+    void invalidate(size_t block_index);
+
+    struct Stats
+    {
+        size_t capacity_blocks;
+        size_t resident_blocks;
+        size_t hits;
+        size_t misses;
+        size_t evictions;
+    };
+
+    Stats getStats() const;
+
+private:
+    enum class ListId
+    {
+        T1,
+        T2,
+        B1,
+        B2
+    };
+
+    struct Entry
+    {
+        ListId list;
+        std::list<size_t>::iterator position;
+        size_t slot; // Hueco en 'storage' (solo en T1/T2)
+    };
+
+    size_t capacity;
+    size_t block_size;
+    size_t target_t1; // Parámetro adaptativo 'p' de ARC
+    std::list<size_t> t1, t2, b1, b2; // front = más reciente
+    std::unordered_map<size_t, Entry> entries;
+    std::vector<char> storage;
+    std::vector<size_t> free_slots;
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    mutable std::mutex cache_mutex;
+
+    std::list<size_t> &listFor(ListId id);
+
+    // Mover una entrada a la cabeza de otra lista
+    void moveTo(size_t block_index, Entry &entry, ListId target);
+
+    // Expulsar un bloque residente hacia su lista fantasma (REPLACE de ARC)
+    void replace(bool hit_in_b2);
+
+    // Eliminar la entrada menos reciente de una lista fantasma
+    void dropGhost(ListId id);
+};
@@ -0,0 +1,170 @@
+#include "BlockCompressor.h"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace {
+constexpr size_t MIN_MATCH = 4;
+constexpr size_t LAST_LITERALS = 5;   // Los últimos bytes siempre van como literales
+constexpr size_t MATCH_LIMIT = 12;    // Ninguna coincidencia empieza tan cerca del final
+constexpr size_t MAX_OFFSET = 65535;
+constexpr int HASH_BITS = 12;
+
+inline uint32_t read32(const char* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline uint32_t hash4(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Escribir una longitud que no cupo en el nibble del token (bytes de 255 y un resto)
+inline bool writeLength(size_t length, char*& out, const char* end) {
+    while (length >= 255) {
+        if (out >= end) {
+            return false;
+        }
+        *out++ = static_cast<char>(255);
+        length -= 255;
+    }
+    if (out >= end) {
+        return false;
+    }
+    *out++ = static_cast<char>(length);
+    return true;
+}
+
+// Emitir una secuencia: literales [anchor, anchor + literals) y, si match_length > 0, la coincidencia
+inline bool emitSequence(const char* anchor, size_t literals, size_t offset, size_t match_length,
+                         char*& out, const char* end) {
+    if (out >= end) {
+        return false;
+    }
+    char* token = out++;
+    uint8_t token_value = static_cast<uint8_t>((literals >= 15 ? 15 : literals) << 4);
+    if (literals >= 15 && !writeLength(literals - 15, out, end)) {
+        return false;
+    }
+    if (static_cast<size_t>(end - out) < literals) {
+        return false;
+    }
+    std::memcpy(out, anchor, literals);
+    out += literals;
+
+    if (match_length > 0) {
+        if (end - out < 2) {
+            return false;
+        }
+        *out++ = static_cast<char>(offset & 0xff);
+        *out++ = static_cast<char>(offset >> 8);
+        size_t extra = match_length - MIN_MATCH;
+        token_value |= static_cast<uint8_t>(extra >= 15 ? 15 : extra);
+        if (extra >= 15 && !writeLength(extra - 15, out, end)) {
+            return false;
+        }
+    }
+    *token = static_cast<char>(token_value);
+    return true;
+}
+
+// Leer una longitud extendida; false si se sale de la entrada
+inline bool readLength(const uint8_t*& in, const uint8_t* end, size_t& length) {
+    uint8_t byte;
+    do {
+        if (in >= end) {
+            return false;
+        }
+        byte = *in++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+}
+
+size_t BlockCompressor::compress(const char* source, size_t size, char* destination, size_t capacity) {
+    char* out = destination;
+    const char* out_end = destination + capacity;
+    size_t anchor = 0;
+
+    if (size > MATCH_LIMIT) {
+        // Tabla de posiciones por hash de 4 bytes (posición + 1; 0 = vacía)
+        std::vector<uint32_t> table(size_t(1) << HASH_BITS, 0);
+        size_t match_start_limit = size - MATCH_LIMIT;
+        size_t match_end_limit = size - LAST_LITERALS;
+        size_t pos = 0;
+        while (pos < match_start_limit) {
+            uint32_t sequence = read32(source + pos);
+            uint32_t& slot = table[hash4(sequence)];
+            size_t candidate = slot;
+            slot = static_cast<uint32_t>(pos + 1);
+            if (candidate == 0 || pos - (candidate - 1) > MAX_OFFSET || read32(source + candidate - 1) != sequence) {
+                pos++;
+                continue;
+            }
+
+            size_t reference = candidate - 1;
+            size_t length = MIN_MATCH;
+            while (pos + length < match_end_limit && source[reference + length] == source[pos + length]) {
+                length++;
+            }
+            if (!emitSequence(source + anchor, pos - anchor, pos - reference, length, out, out_end)) {
+                return 0;
+            }
+            pos += length;
+            anchor = pos;
+        }
+    }
+
+    // Última secuencia: solo literales
+    if (!emitSequence(source + anchor, size - anchor, 0, 0, out, out_end)) {
+        return 0;
+    }
+    return static_cast<size_t>(out - destination);
+}
+
+size_t BlockCompressor::decompress(const char* source, size_t size, char* destination, size_t capacity) {
+    const uint8_t* in = reinterpret_cast<const uint8_t*>(source);
+    const uint8_t* in_end = in + size;
+    size_t produced = 0;
+
+    while (in < in_end) {
+        uint8_t token = *in++;
+        size_t literals = token >> 4;
+        if (literals == 15 && !readLength(in, in_end, literals)) {
+            return 0;
+        }
+        if (static_cast<size_t>(in_end - in) < literals || capacity - produced < literals) {
+            return 0;
+        }
+        std::memcpy(destination + produced, in, literals);
+        in += literals;
+        produced += literals;
+        if (in == in_end) {
+            break; // última secuencia
+        }
+
+        if (in_end - in < 2) {
+            return 0;
+        }
+        size_t offset = static_cast<size_t>(in[0]) | (static_cast<size_t>(in[1]) << 8);
+        in += 2;
+        size_t length = token & 15;
+        if (length == 15 && !readLength(in, in_end, length)) {
+            return 0;
+        }
+        length += MIN_MATCH;
+        if (offset == 0 || offset > produced || capacity - produced < length) {
+            return 0;
+        }
+        // Copia byte a byte: origen y destino pueden solaparse (repeticiones)
+        char* out = destination + produced;
+        const char* match = out - offset;
+        for (size_t i = 0; i < length; i++) {
+            out[i] = match[i];
+        }
+        produced += length;
+    }
+    return produced;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <cstddef>
+
+// Compresor LZ77 rápido para bloques individuales, con el formato de bloque de LZ4:
+// secuencias [token][literales][offset de 2 bytes][longitud extra], donde el token lleva
+// en el nibble alto la longitud de los literales y en el bajo la de la coincidencia - 4.
+// Pensado para bloques de hasta 64 KB (los offsets caben en 16 bits).
+class BlockCompressor
+{
+public:
+    // Comprimir 'size' bytes en 'destination'. Devuelve el tamaño comprimido, o 0 si
+    // no cabe en 'capacity' bytes (el bloque no compensa guardarlo comprimido).
+    static size_t compress(const char *source, size_t size, char *destination, size_t capacity);
+
+    // Descomprimir en 'destination'. Devuelve los bytes producidos, o 0 si los datos
+    // están corruptos o no caben en 'capacity'.
+    static size_t decompress(const char *source, size_t size, char *destination, size_t capacity);
+};
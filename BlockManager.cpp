@@ -1,15 +1,124 @@
 #include "BlockManager.h"
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <climits>
+#include <cerrno>
+#include <atomic>
 #include <iostream>
 #include <cstring>
+#include <cstdio>
 #include <fstream>
 #include <algorithm>
+#include <chrono>
+#include "Crc32c.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BLOCK_ZERO_X86 1
+#endif
 
-BlockManager::BlockManager(const char* file_path, size_t total_size) 
-    : data_file_path(file_path), metadata_file_path(std::string(file_path) + ".meta") {
-    
-    total_blocks = total_size / BLOCK_SIZE;
+namespace {
+// Identificador del formato de storage.bin ("COWSTORE")
+constexpr uint64_t STORE_MAGIC = 0x45524F5453574F43ULL;
+constexpr uint32_t STORE_FORMAT_VERSION = 4;
+
+// Un bloque solo se guarda comprimido si ahorra al menos 1/8 de su tamaño
+size_t packLimit(size_t block_size) {
+    return block_size - block_size / 8;
+}
+
+size_t roundUpToBlock(size_t bytes, size_t block_size) {
+    return (bytes + block_size - 1) / block_size * block_size;
+}
+
+// Los grupos de asignación no bajan de este tamaño (en almacenes pequeños, un solo grupo)
+constexpr size_t MIN_GROUP_BLOCKS = 512;
+
+// Registros del diario de deduplicación que se toleran antes de reescribir la instantánea
+// (además del doble del número de entradas)
+constexpr size_t MIN_DEDUP_JOURNAL = 4096;
+
+bool validBlockSize(size_t size) {
+    return size >= MIN_BLOCK_SIZE && size <= MAX_BLOCK_SIZE && (size & (size - 1)) == 0;
+}
+
+bool isZeroScalar(const char* data, size_t size) {
+    uint64_t any = 0;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        any |= word;
+    }
+    for (; i < size; i++) {
+        any |= static_cast<unsigned char>(data[i]);
+    }
+    return any == 0;
+}
+
+#ifdef BLOCK_ZERO_X86
+// 128 bytes por iteración: OR de cuatro registros de 256 bits y una sola comprobación,
+// saliendo en cuanto aparece un byte distinto de cero
+__attribute__((target("avx2"))) bool isZeroAvx2(const char* data, size_t size) {
+    size_t i = 0;
+    for (; i + 128 <= size; i += 128) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32));
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 64));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 96));
+        __m256i any = _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d));
+        if (!_mm256_testz_si256(any, any)) {
+            return false;
+        }
+    }
+    return isZeroScalar(data + i, size - i);
+}
+#endif
+
+using ZeroKernel = bool (*)(const char*, size_t);
+
+// Elegir la implementación una sola vez según la CPU
+ZeroKernel zeroKernel() {
+    static const ZeroKernel selected = [] {
+#ifdef BLOCK_ZERO_X86
+        if (__builtin_cpu_supports("avx2")) {
+            return static_cast<ZeroKernel>(isZeroAvx2);
+        }
+#endif
+        return static_cast<ZeroKernel>(isZeroScalar);
+    }();
+    return selected;
+}
+
+// fsync del directorio que contiene 'path', para que un rename en él sea durable
+void syncParentDirectory(const std::string& path) {
+    size_t slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    int dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+}
+
+// Suma de un bloque completo; 0 se reserva para "sin suma", así que un CRC nulo se guarda como 1
+uint32_t blockChecksum(const char* data, size_t block_size) {
+    uint32_t crc = Crc32c::compute(data, block_size);
+    return crc != 0 ? crc : 1;
+}
+}
+
+BlockManager::BlockManager(const char* file_path, size_t total_size, const StorageOptions& options) 
+    : data_file_path(file_path), legacy_map_path(std::string(file_path) + ".meta"),
+      block_size(options.block_size), punch_holes(options.punch_holes), allocation_groups(options.allocation_groups),
+      backend(options.backend), mapped_data(nullptr), mapped_size(0),
+      dedup_path(std::string(file_path) + ".dedup"), dedup_descriptor(-1), dedup_journal_records(0), dedup_hits(0),
+      compression(false), packmap_offset(0), packmap_bytes(0), packed_blocks(0), packed_bytes(0), pack_slots(0),
+      open_slot(BlockBitmap::npos), open_slot_fill(0), checksumming(false), verify_reads(false),
+      checksum_offset(0), checksum_bytes(0), checksum_failures(0),
+      scrub_status{false, 0, 0, 0, {}}, scrub_stop(false) {
     
     // Abrir archivo de datos
     file_descriptor = open(file_path, O_RDWR | O_CREAT, 0644);
@@ -18,80 +127,824 @@ BlockManager::BlockManager(const char* file_path, size_t total_size)
         exit(EXIT_FAILURE);
     }
     
-    // Verificar tamaño del archivo y expandirlo si es necesario
     off_t current_size = lseek(file_descriptor, 0, SEEK_END);
-    if (current_size < static_cast<off_t>(total_size)) {
-        // Crear archivo del tamaño adecuado
-        lseek(file_descriptor, total_size - 1, SEEK_SET);
-        char null_byte = 0;
-        write(file_descriptor, &null_byte, 1);
+    if (loadSuperblock()) {
+        // Almacén existente: el tamaño y la compresión los fija la cabecera
+        extendFile();
+        loadBitmap();
+        if (options.compression && !compression) {
+            std::cerr << "Advertencia: el almacén se creó sin compresión; se guarda sin comprimir\n";
+        }
+    } else {
+        // Almacén nuevo o con el formato anterior (datos desde el offset 0 y mapa en .meta).
+        // El formato anterior siempre usaba bloques de BLOCK_SIZE.
+        bool legacy = current_size > 0;
+        if (legacy || !validBlockSize(block_size)) {
+            if (!legacy) {
+                std::cerr << "Advertencia: tamaño de bloque " << block_size << " no válido, usando " << BLOCK_SIZE << "\n";
+            }
+            block_size = BLOCK_SIZE;
+        }
+        total_blocks = std::max(total_size, static_cast<size_t>(current_size)) / block_size;
+        max_blocks = std::max(options.max_size / block_size, total_blocks.load());
+        // Sin huecos, empaquetar ocuparía más que guardar sin comprimir (ver StorageOptions)
+        compression = options.compression && options.punch_holes;
+        if (options.compression && !options.punch_holes) {
+            std::cerr << "Advertencia: la compresión requiere punch_holes; el almacén se crea sin comprimir\n";
+        }
+        checksumming = options.checksums;
+        computeLayout();
+        block_map.reset(total_blocks, max_blocks, allocationGroupSize());
+
+        // Un almacén antiguo se convierte en un archivo nuevo que sustituye al original con
+        // rename: hasta entonces el original no se toca, así que si la conversión se interrumpe
+        // (caída o disco lleno) el siguiente arranque lo vuelve a encontrar entero y empieza de nuevo
+        int legacy_descriptor = -1;
+        std::string migration_path = data_file_path + ".migrating";
+        if (legacy) {
+            legacy_descriptor = file_descriptor;
+            file_descriptor = open(migration_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (file_descriptor < 0) {
+                perror("Error creating migrated block file");
+                exit(EXIT_FAILURE);
+            }
+        }
+        extendFile();
+        if (legacy) {
+            migrateLegacyStore(legacy_descriptor, static_cast<size_t>(current_size));
+        }
+        writeSuperblock();
+        block_map.markAllDirty();
+        packmap_dirty.markAll();
+        checksum_dirty.markAll();
+        flushRegions();
+        fsync(file_descriptor);
+        if (legacy) {
+            if (rename(migration_path.c_str(), file_path) != 0) {
+                perror("Error replacing migrated block file");
+                std::remove(migration_path.c_str());
+                exit(EXIT_FAILURE);
+            }
+            syncParentDirectory(data_file_path);
+            close(legacy_descriptor);
+            std::remove(legacy_map_path.c_str());
+        }
+    }
+    growth_blocks = std::max<size_t>(options.growth_increment / block_size, 1);
+    ref_counts.assign(total_blocks, 0);
+    loadPackMap();
+    loadChecksums();
+    verify_reads = checksumming && options.verify_reads;
+
+    // Índice de deduplicación: las entradas de bloques libres se descartan; las obsoletas
+    // (bloque reutilizado tras una caída) no hacen daño porque se comparan los bytes
+    // Si el archivo falta o termina a medias, el primer vaciado reescribe la instantánea
+    if (options.dedup) {
+        dedup_index = std::make_unique<DedupIndex>();
+        if (dedup_index->load(dedup_path, dedup_journal_records)) {
+            dedup_descriptor = open(dedup_path.c_str(), O_WRONLY | O_APPEND);
+        }
+        for (size_t block = 0; block < total_blocks; block++) {
+            if (!block_map.test(block)) {
+                dedup_index->erase(block);
+            }
+        }
+    }
+    
+    // Mapear el archivo si se pidió; si falla, seguir con el descriptor
+    if (backend == StorageBackend::MemoryMapped && !mapStorage()) {
+        std::cerr << "Advertencia: no se pudo mapear el archivo, usando descriptor\n";
+        backend = StorageBackend::FileDescriptor;
     }
     
-    // Inicializar mapa de bloques (cargar desde metadata si existe)
-    loadBlockMap();
+    // E/S directa: segundo descriptor con O_DIRECT solo para los bloques de datos
+    data_descriptor = file_descriptor;
+    // (solo con bloques de al menos 4 KB: muchos dispositivos no admiten transferencias menores)
+    if (backend == StorageBackend::FileDescriptor && options.direct_io && block_size < 4096) {
+        std::cerr << "Advertencia: O_DIRECT requiere bloques de al menos 4 KB, usando la caché del sistema\n";
+    } else if (backend == StorageBackend::FileDescriptor && options.direct_io) {
+        int direct = open(file_path, O_RDWR | O_DIRECT);
+        if (direct >= 0) {
+            data_descriptor = direct;
+            buffer_pool = std::make_unique<AlignedBufferPool>(options.direct_buffers, block_size, block_size);
+        } else {
+            std::cerr << "Advertencia: O_DIRECT no disponible, usando la caché del sistema\n";
+        }
+    }
+    
+    // Motor de E/S asíncrona y caché de bloques para el backend de descriptor
+    if (backend == StorageBackend::FileDescriptor) {
+        async_io = std::make_unique<AsyncIO>(data_descriptor);
+        if (options.cache_blocks > 0) {
+            cache = std::make_unique<BlockCache>(options.cache_blocks, block_size);
+        }
+    }
 }
 
 BlockManager::~BlockManager() {
-    // Guardar mapa de bloques antes de cerrar
-    saveBlockMap();
+    // Parar la revisión, terminar la E/S pendiente y guardar las páginas modificadas del mapa de bits
+    stopScrub();
+    async_io.reset();
+    if (mapped_data) {
+        flushDirtyRanges();
+        munmap(mapped_data, mapped_size);
+    }
+    flushRegions();
+    flushDedupIndex();
+    if (dedup_descriptor >= 0) {
+        close(dedup_descriptor);
+    }
+    if (data_descriptor != file_descriptor) {
+        close(data_descriptor);
+    }
     close(file_descriptor);
 }
 
-void BlockManager::loadBlockMap() {
-    block_map.clear();
-    // Inicializar todos los bloques como libres
-    for (size_t i = 0; i < total_blocks; i++) {
-        block_map[i] = false;
+void BlockManager::computeLayout() {
+    // [superbloque: 1 bloque][mapa de bits: 1 bit por bloque hasta el tope, redondeado a bloques]
+    // [tabla de compresión: una PackedLocation por bloque, solo si hay compresión]
+    // [sumas: un uint32_t por bloque, solo si hay sumas][datos]
+    bitmap_offset = block_size;
+    bitmap_bytes = roundUpToBlock((max_blocks + 63) / 64 * sizeof(uint64_t), block_size);
+    packmap_offset = compression ? bitmap_offset + bitmap_bytes : 0;
+    packmap_bytes = compression ? roundUpToBlock(max_blocks * sizeof(PackedLocation), block_size) : 0;
+    checksum_offset = checksumming ? bitmap_offset + bitmap_bytes + packmap_bytes : 0;
+    checksum_bytes = checksumming ? roundUpToBlock(max_blocks * sizeof(uint32_t), block_size) : 0;
+    data_offset = bitmap_offset + bitmap_bytes + packmap_bytes + checksum_bytes;
+    packmap_dirty.reset(packmap_bytes / block_size);
+    checksum_dirty.reset(checksum_bytes / block_size);
+    // Las sumas se dimensionan hasta el tope para que los lectores no compitan con el crecimiento
+    checksums = std::vector<std::atomic<uint32_t>>(checksumming ? max_blocks : 0);
+}
+
+void BlockManager::extendFile() {
+    off_t required = static_cast<off_t>(data_offset + total_blocks * block_size);
+    if (lseek(file_descriptor, 0, SEEK_END) < required && ftruncate(file_descriptor, required) != 0) {
+        perror("Error resizing block file");
+        exit(EXIT_FAILURE);
     }
-    
-    // Intentar cargar mapa de bloques desde archivo de metadatos
-    std::ifstream meta_file(metadata_file_path, std::ios::binary);
+}
+
+bool BlockManager::loadSuperblock() {
+    Superblock header;
+    if (pread(file_descriptor, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) ||
+        header.magic != STORE_MAGIC) {
+        return false;
+    }
+    if (header.format_version > STORE_FORMAT_VERSION || !validBlockSize(header.block_size)) {
+        std::cerr << "Error: formato de almacén no compatible (versión " << header.format_version
+                  << ", bloques de " << header.block_size << " bytes)\n";
+        exit(EXIT_FAILURE);
+    }
+
+    block_size = header.block_size;
+    total_blocks = header.total_blocks;
+    max_blocks = header.max_blocks != 0 ? header.max_blocks : header.total_blocks;
+    compression = header.packmap_bytes != 0;
+    checksumming = header.checksum_bytes != 0;
+    computeLayout();
+    if (header.bitmap_offset != bitmap_offset || header.bitmap_bytes != bitmap_bytes ||
+        header.packmap_offset != packmap_offset || header.packmap_bytes != packmap_bytes ||
+        header.checksum_offset != checksum_offset || header.checksum_bytes != checksum_bytes ||
+        header.data_offset != data_offset) {
+        std::cerr << "Error: cabecera de almacén inconsistente\n";
+        exit(EXIT_FAILURE);
+    }
+    return true;
+}
+
+void BlockManager::writeSuperblock() {
+    // El superbloque ocupa un bloque completo; el resto queda a cero
+    std::vector<char> block(block_size, 0);
+    Superblock header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic = STORE_MAGIC;
+    header.format_version = STORE_FORMAT_VERSION;
+    header.block_size = block_size;
+    header.total_blocks = total_blocks;
+    header.bitmap_offset = bitmap_offset;
+    header.bitmap_bytes = bitmap_bytes;
+    header.data_offset = data_offset;
+    header.max_blocks = max_blocks;
+    header.packmap_offset = packmap_offset;
+    header.packmap_bytes = packmap_bytes;
+    header.checksum_offset = checksum_offset;
+    header.checksum_bytes = checksum_bytes;
+    std::memcpy(block.data(), &header, sizeof(header));
+    if (pwrite(file_descriptor, block.data(), block_size, 0) != static_cast<ssize_t>(block_size)) {
+        perror("Error writing superblock");
+    }
+}
+
+void BlockManager::loadBitmap() {
+    // Una sola lectura de la región del mapa; los niveles de resumen se reconstruyen en memoria
+    block_map.reset(total_blocks, max_blocks, allocationGroupSize());
+    std::vector<uint64_t> words((total_blocks + 63) / 64);
+    size_t bytes = words.size() * sizeof(uint64_t);
+    if (pread(file_descriptor, words.data(), bytes, bitmap_offset) != static_cast<ssize_t>(bytes)) {
+        perror("Error reading block bitmap");
+        return;
+    }
+    block_map.assignWords(words.data(), words.size());
+}
+
+void BlockManager::loadPackMap() {
+    if (!compression) {
+        return;
+    }
+    packed_map.assign(total_blocks, PackedLocation{0, 0, 0});
+    pack_members.assign(total_blocks, 0);
+    size_t bytes = packed_map.size() * sizeof(PackedLocation);
+    if (bytes > 0 && pread(file_descriptor, packed_map.data(), bytes, packmap_offset) != static_cast<ssize_t>(bytes)) {
+        perror("Error reading compression table");
+    }
+
+    // Contar los miembros vivos de cada hueco; las entradas de bloques libres o inválidas se descartan
+    for (size_t block = 0; block < packed_map.size(); block++) {
+        PackedLocation& location = packed_map[block];
+        if (location.length == 0) {
+            continue;
+        }
+        bool valid = block_map.test(block) && location.slot < total_blocks && block_map.test(location.slot) &&
+                     location.length <= block_size && location.offset <= block_size - location.length;
+        if (!valid) {
+            location = PackedLocation{0, 0, 0};
+            markPackMapDirty(block);
+            continue;
+        }
+        if (pack_members[location.slot]++ == 0) {
+            pack_slots++;
+        }
+        packed_blocks++;
+        packed_bytes += location.length;
+    }
+}
+
+void BlockManager::loadChecksums() {
+    if (!checksumming) {
+        return;
+    }
+    std::vector<uint32_t> stored(checksums.size(), 0);
+    size_t bytes = stored.size() * sizeof(uint32_t);
+    if (bytes > 0 && pread(file_descriptor, stored.data(), bytes, checksum_offset) != static_cast<ssize_t>(bytes)) {
+        perror("Error reading block checksums");
+        std::fill(stored.begin(), stored.end(), 0);
+    }
+
+    // Las sumas de bloques libres sobran (p. ej. tras una caída antes de guardar el mapa)
+    for (size_t block = 0; block < stored.size(); block++) {
+        if (stored[block] != 0 && (block >= total_blocks || !block_map.test(block))) {
+            stored[block] = 0;
+            markChecksumDirty(block);
+        }
+        checksums[block].store(stored[block], std::memory_order_relaxed);
+    }
+}
+
+void BlockManager::DirtyPages::reset(size_t page_count) {
+    flags.assign(page_count, false);
+    pages.clear();
+}
+
+void BlockManager::DirtyPages::mark(size_t page) {
+    if (page < flags.size() && !flags[page]) {
+        flags[page] = true;
+        pages.push_back(page);
+    }
+}
+
+void BlockManager::DirtyPages::markAll() {
+    for (size_t page = 0; page < flags.size(); page++) {
+        mark(page);
+    }
+}
+
+void BlockManager::markPackMapDirty(size_t block_index) {
+    packmap_dirty.mark(block_index * sizeof(PackedLocation) / block_size);
+}
+
+void BlockManager::markChecksumDirty(size_t block_index) {
+    checksum_dirty.mark(block_index * sizeof(uint32_t) / block_size);
+}
+
+void BlockManager::setChecksumLocked(size_t block_index, uint32_t checksum) {
+    if (checksumming && checksums[block_index].load(std::memory_order_relaxed) != checksum) {
+        checksums[block_index].store(checksum, std::memory_order_relaxed);
+        markChecksumDirty(block_index);
+    }
+}
+
+bool BlockManager::checkBlock(size_t block_index, const char* data) {
+    if (!verify_reads) {
+        return true;
+    }
+    uint32_t expected = checksums[block_index].load(std::memory_order_relaxed);
+    if (expected == 0 || blockChecksum(data, block_size) == expected) {
+        return true;
+    }
+    checksum_failures++;
+    std::cerr << "Error: la suma de verificación del bloque " << block_index << " no coincide\n";
+    return false;
+}
+
+bool BlockManager::checkBlocks(const BlockTargets& targets) {
+    bool intact = true;
+    for (const auto& [block_index, position] : targets) {
+        intact = checkBlock(block_index, position) && intact;
+    }
+    return intact;
+}
+
+void BlockManager::setUsedLocked(size_t block_index) {
+    // El grupo anota su parte del mapa como pendiente de escribir
+    block_map.set(block_index);
+}
+
+bool BlockManager::clearUsedLocked(size_t block_index) {
+    if (!block_map.clear(block_index)) {
+        return false;
+    }
+    if (compression) {
+        releasePackedLocked(block_index);
+    }
+    if (dedup_index) {
+        dedup_index->erase(block_index);
+    }
+    setChecksumLocked(block_index, 0);
+    return true;
+}
+
+bool BlockManager::growLocked(size_t needed_blocks) {
+    size_t current = total_blocks;
+    if (current >= max_blocks || max_blocks - current < needed_blocks) {
+        return false;
+    }
+
+    // Crecer en múltiplos del incremento configurado, sin pasar del tope
+    size_t steps = (needed_blocks + growth_blocks - 1) / growth_blocks;
+    size_t new_total = std::min(max_blocks, current + steps * growth_blocks);
+
+    // fallocate reserva el espacio de verdad, así que un disco lleno se detecta aquí y no al escribir
+    off_t old_end = blockOffset(current);
+    off_t added = static_cast<off_t>((new_total - current) * block_size);
+    if (fallocate(file_descriptor, 0, old_end, added) != 0 &&
+        (errno != EOPNOTSUPP || ftruncate(file_descriptor, old_end + added) != 0)) {
+        perror("Error growing block file");
+        return false;
+    }
+
+    // Los grupos que cubren los bloques nuevos quedan pendientes de escribir
+    block_map.resize(new_total);
+    ref_counts.resize(new_total, 0);
+    if (compression) {
+        packed_map.resize(new_total, PackedLocation{0, 0, 0});
+        pack_members.resize(new_total, 0);
+    }
+    total_blocks = new_total;
+    writeSuperblock();
+    return true;
+}
+
+void BlockManager::punchHolesLocked(const std::vector<size_t>& block_indices) {
+    if (!punch_holes || block_indices.empty()) {
+        return;
+    }
+
+    size_t i = 0;
+    while (i < block_indices.size()) {
+        size_t first = block_indices[i];
+        size_t last = first;
+        while (i + 1 < block_indices.size() && block_indices[i + 1] == last + 1) {
+            last = block_indices[++i];
+        }
+        i++;
+
+        off_t length = static_cast<off_t>((last - first + 1) * block_size);
+        if (fallocate(file_descriptor, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, blockOffset(first), length) != 0) {
+            if (errno == EOPNOTSUPP) {
+                // El sistema de archivos no admite huecos: no volver a intentarlo
+                punch_holes = false;
+                return;
+            }
+            perror("Error punching hole in block file");
+        }
+    }
+}
+
+void BlockManager::flushRegions() {
+    // Copiar las páginas sucias bajo el mutex y escribirlas después
+    AllocationGroups::DirtyWords bitmap_words;
+    RegionRuns packmap_runs;
+    RegionRuns checksum_runs;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        bitmap_words = block_map.takeDirtyWords();
+        packmap_runs = collectDirtyPagesLocked(packmap_dirty, reinterpret_cast<const char*>(packed_map.data()),
+                                               packed_map.size() * sizeof(PackedLocation));
+        // Las sumas solo se modifican bajo state_mutex, así que pueden copiarse como bytes
+        static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "las sumas deben poder copiarse tal cual");
+        checksum_runs = collectDirtyPagesLocked(checksum_dirty, reinterpret_cast<const char*>(checksums.data()),
+                                                checksums.size() * sizeof(uint32_t));
+    }
+    for (const auto& [first_word, words] : bitmap_words) {
+        size_t bytes = words.size() * sizeof(uint64_t);
+        off_t offset = bitmap_offset + first_word * sizeof(uint64_t);
+        if (pwrite(file_descriptor, words.data(), bytes, offset) != static_cast<ssize_t>(bytes)) {
+            perror("Error writing block bitmap");
+        }
+    }
+    writeRegionPages(packmap_runs, packmap_offset, "Error writing compression table");
+    writeRegionPages(checksum_runs, checksum_offset, "Error writing block checksums");
+}
+
+BlockManager::RegionRuns BlockManager::collectDirtyPagesLocked(DirtyPages& dirty, const char* bytes, size_t byte_count) {
+    // Agrupar páginas contiguas en una sola escritura; lo que queda más allá de los datos en memoria va a cero
+    RegionRuns runs; // (primera página, contenido)
+    std::sort(dirty.pages.begin(), dirty.pages.end());
+    for (size_t page : dirty.pages) {
+        dirty.flags[page] = false;
+        if (runs.empty() || runs.back().first + runs.back().second.size() / block_size != page) {
+            runs.push_back({page, {}});
+        }
+        std::vector<char>& content = runs.back().second;
+        size_t begin = std::min(page * block_size, byte_count);
+        size_t end = std::min(page * block_size + block_size, byte_count);
+        if (begin < end) {
+            content.insert(content.end(), bytes + begin, bytes + end);
+        }
+        content.resize(content.size() + (block_size - (end - begin)), 0);
+    }
+    dirty.pages.clear();
+    return runs;
+}
+
+void BlockManager::writeRegionPages(const RegionRuns& runs, uint64_t region_offset, const char* error_message) {
+    for (const auto& [page, content] : runs) {
+        off_t offset = region_offset + page * block_size;
+        if (pwrite(file_descriptor, content.data(), content.size(), offset) != static_cast<ssize_t>(content.size())) {
+            perror(error_message);
+        }
+    }
+}
+
+void BlockManager::migrateLegacyStore(int legacy_descriptor, size_t legacy_size) {
+    // Formato anterior: mapa en storage.bin.meta como pares (size_t índice, bool usado).
+    // Sin ese archivo se conservan todos los bloques existentes; el GC recupera los huérfanos.
+    size_t legacy_blocks = std::min(legacy_size / block_size, total_blocks.load());
+    std::ifstream meta_file(legacy_map_path, std::ios::binary);
     if (meta_file) {
-        // Formato: número de bloque (size_t) + estado (bool)
         size_t block_number;
         bool is_used;
-        
         while (meta_file.read(reinterpret_cast<char*>(&block_number), sizeof(size_t)) &&
                meta_file.read(reinterpret_cast<char*>(&is_used), sizeof(bool))) {
-            if (block_number < total_blocks) {
-                block_map[block_number] = is_used;
+            if (block_number < legacy_blocks && is_used) {
+                block_map.set(block_number);
             }
         }
         meta_file.close();
+    } else {
+        for (size_t block = 0; block < legacy_blocks; block++) {
+            block_map.set(block);
+        }
     }
+
+    // Copiar los bloques usados detrás de la cabecera del archivo nuevo. Si falla, el archivo
+    // a medias se borra y el original sigue intacto
+    std::vector<char> buffer(block_size);
+    for (size_t block = 0; block < legacy_blocks; block++) {
+        if (!block_map.test(block)) {
+            continue;
+        }
+        off_t source = block * block_size;
+        if (pread(legacy_descriptor, buffer.data(), block_size, source) != static_cast<ssize_t>(block_size) ||
+            pwrite(file_descriptor, buffer.data(), block_size, blockOffset(block)) != static_cast<ssize_t>(block_size)) {
+            perror("Error migrating block store");
+            std::remove((data_file_path + ".migrating").c_str());
+            exit(EXIT_FAILURE);
+        }
+    }
+    std::cout << "Almacén migrado al formato con superbloque (" << block_map.count() << " bloques usados)\n";
 }
 
-void BlockManager::saveBlockMap() {
-    std::ofstream meta_file(metadata_file_path, std::ios::binary | std::ios::trunc);
-    if (!meta_file) {
-        std::cerr << "Error: No se pudo guardar el mapa de bloques\n";
+bool BlockManager::mapStorage() {
+    // Se mapea el archivo completo para que los offsets coincidan con blockOffset().
+    // Se reserva hasta el tope de crecimiento para no tener que remapear (los punteros
+    // de blockData siguen siendo válidos); solo se accede a bloques ya dentro del archivo.
+    mapped_size = data_offset + max_blocks * block_size;
+    if (total_blocks == 0) {
+        return false;
+    }
+    void* region = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, file_descriptor, 0);
+    if (region == MAP_FAILED) {
+        perror("Error mapping block file");
+        mapped_size = 0;
+        return false;
+    }
+    mapped_data = static_cast<char*>(region);
+    return true;
+}
+
+void BlockManager::flushDirtyRanges() {
+    if (!mapped_data) {
         return;
     }
-    
-    // Guardar todos los bloques y su estado
-    for (const auto& [block_number, is_used] : block_map) {
-        meta_file.write(reinterpret_cast<const char*>(&block_number), sizeof(size_t));
-        meta_file.write(reinterpret_cast<const char*>(&is_used), sizeof(bool));
+
+    // Tomar la lista de bloques sucios y soltar el mutex antes de hacer msync
+    std::vector<size_t> dirty;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        dirty.swap(dirty_blocks);
+    }
+    if (dirty.empty()) {
+        return;
+    }
+
+    // Ordenar y agrupar bloques consecutivos para hacer un msync por rango
+    std::sort(dirty.begin(), dirty.end());
+    dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+
+    size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t i = 0;
+    while (i < dirty.size()) {
+        size_t first = dirty[i];
+        size_t last = first;
+        while (i + 1 < dirty.size() && dirty[i + 1] == last + 1) {
+            last = dirty[++i];
+        }
+        i++;
+
+        // msync exige direcciones alineadas a página
+        size_t begin = blockOffset(first) / page_size * page_size;
+        size_t end = blockOffset(last) + block_size;
+        msync(mapped_data + begin, end - begin, MS_SYNC);
     }
-    
-    meta_file.close();
 }
 
-size_t BlockManager::allocateBlock() {
-    for (auto& pair : block_map) {
-        if (!pair.second) {
-            pair.second = true;
-            return pair.first;
+size_t BlockManager::allocationGroupSize() const {
+    size_t groups = std::max<size_t>(allocation_groups, 1);
+    size_t size = std::max(MIN_GROUP_BLOCKS, (max_blocks + groups - 1) / groups);
+    return (size + 63) / 64 * 64;
+}
+
+size_t BlockManager::threadGroup() const {
+    // Cada hilo recibe un turno la primera vez que reserva; el grupo es ese turno módulo los grupos con bloques
+    static std::atomic<size_t> next_thread{0};
+    thread_local size_t thread_slot = next_thread++;
+    return thread_slot % block_map.activeGroups();
+}
+
+size_t BlockManager::takeFreeBlock(size_t home) {
+    size_t groups = block_map.activeGroups();
+    for (size_t i = 0; i < groups; i++) {
+        size_t block_index = block_map.allocateOne((home + i) % groups);
+        if (block_index != AllocationGroups::npos) {
+            return block_index;
         }
     }
+    return AllocationGroups::npos;
+}
+
+size_t BlockManager::allocateLocked() {
+    size_t block_index = takeFreeBlock(threadGroup());
+    if (block_index == AllocationGroups::npos && growLocked(1)) {
+        block_index = takeFreeBlock(threadGroup());
+    }
+    return block_index;
+}
+
+size_t BlockManager::allocateBlock() {
+    // Caso común: reservar con el mutex de un grupo; el mutex general solo para ampliar
+    size_t block_index = takeFreeBlock(threadGroup());
+    if (block_index != AllocationGroups::npos) {
+        return block_index;
+    }
+    std::lock_guard<std::mutex> lock(state_mutex);
+    block_index = allocateLocked();
+    if (block_index != AllocationGroups::npos) {
+        return block_index;
+    }
     std::cerr << "No hay bloques disponibles\n";
     return static_cast<size_t>(-1);
 }
 
+std::vector<BlockManager::Extent> BlockManager::allocateExtent(size_t count, size_t hint) {
+    std::vector<Extent> extents;
+    if (count == 0) {
+        return extents;
+    }
+
+    // Afinidad: con pista (bloque siguiente al anterior del archivo) se empieza en su grupo;
+    // sin ella, en el grupo del hilo. Así los escritores concurrentes no compiten por el mismo mutex.
+    if (hint >= total_blocks) {
+        hint = 0;
+    }
+    const size_t MAX_PROBES = 64;
+    const int MAX_ATTEMPTS = 4;
+    for (int attempt = 0; attempt < MAX_ATTEMPTS; attempt++) {
+        {
+            // Ampliar antes de buscar si no hay bloques libres suficientes en total. En los reintentos
+            // se amplía aunque el recuento diga que hay sitio: otros hilos lo están consumiendo a la vez.
+            std::lock_guard<std::mutex> lock(state_mutex);
+            size_t available = total_blocks - std::min(block_map.count(), total_blocks.load());
+            size_t needed = attempt > 0 ? count : (available < count ? count - available : 0);
+            if (needed > 0 && !growLocked(needed) && available < count) {
+                break;
+            }
+        }
+        size_t groups = block_map.activeGroups();
+        size_t home = hint != 0 ? block_map.groupOf(hint) : threadGroup();
+
+        // 1. Una única racha de 'count' bloques: primero en el grupo propio (desde 'hint'),
+        //    después en los demás. Cada búsqueda examina un número acotado de rachas.
+        if (count <= block_map.groupSize()) {
+            for (size_t i = 0; i < groups; i++) {
+                size_t start = block_map.allocateRun((home + i) % groups, count, i == 0 ? hint : 0, MAX_PROBES);
+                if (start != AllocationGroups::npos) {
+                    extents.push_back({start, count});
+                    return extents;
+                }
+            }
+        }
+
+        // 2. No hay racha completa: tomar rachas parciales grupo a grupo desde el propio,
+        //    uniendo las que quedan contiguas en el límite entre dos grupos
+        size_t remaining = count;
+        for (size_t i = 0; i < groups && remaining > 0; i++) {
+            size_t group = (home + i) % groups;
+            size_t from = i == 0 ? hint : 0;
+            size_t start = 0;
+            size_t run;
+            while (remaining > 0 && (run = block_map.allocatePartial(group, remaining, from, start)) > 0) {
+                if (!extents.empty() && extents.back().start + extents.back().length == start) {
+                    extents.back().length += run;
+                } else {
+                    extents.push_back({start, run});
+                }
+                remaining -= run;
+                from = start + run;
+            }
+        }
+        if (remaining == 0) {
+            return extents;
+        }
+
+        // Otro hilo se llevó los bloques libres entre la comprobación y la búsqueda: devolverlos y reintentar
+        for (const Extent& extent : extents) {
+            for (size_t block = extent.start; block < extent.start + extent.length; block++) {
+                block_map.clear(block);
+            }
+        }
+        extents.clear();
+    }
+    std::cerr << "No hay bloques disponibles\n";
+    return extents;
+}
+
 void BlockManager::freeBlock(size_t block_index) {
+    if (cache) {
+        cache->invalidate(block_index);
+    }
+    std::lock_guard<std::mutex> lock(state_mutex);
+    if (block_map.test(block_index)) {
+        punchHolesLocked({block_index});
+        clearUsedLocked(block_index);
+    }
+}
+
+size_t BlockManager::findDuplicate(const void* data, const BlockFingerprint& fingerprint) {
+    if (!dedup_index) {
+        return DedupIndex::npos;
+    }
+    size_t candidate;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        candidate = dedup_index->find(fingerprint);
+        if (candidate == DedupIndex::npos || candidate >= total_blocks || !block_map.test(candidate)) {
+            return DedupIndex::npos;
+        }
+    }
+
+    // Confirmar byte a byte (la lectura pasa por la caché de bloques)
+    std::vector<char> existing(block_size);
+    readBlock(candidate, existing.data(), block_size);
+    if (std::memcmp(existing.data(), data, block_size) != 0) {
+        return DedupIndex::npos;
+    }
+    std::lock_guard<std::mutex> lock(state_mutex);
+    dedup_hits++;
+    return candidate;
+}
+
+void BlockManager::registerContent(size_t block_index, const BlockFingerprint& fingerprint) {
+    if (!dedup_index || block_index >= total_blocks) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(state_mutex);
+    dedup_index->insert(fingerprint, block_index);
+}
+
+void BlockManager::flushDedupIndex() {
+    if (!dedup_index) {
+        return;
+    }
+    // Un vaciado a la vez para que los cambios lleguen al diario en el orden en que se recogieron
+    std::lock_guard<std::mutex> file_lock(dedup_file_mutex);
+    DedupIndex::Changes changes;
+    DedupIndex::Entries entries;
+    bool rewrite;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        changes = dedup_index->takeChanges();
+        size_t limit = std::max(MIN_DEDUP_JOURNAL, 2 * dedup_index->size());
+        rewrite = dedup_descriptor < 0 || dedup_journal_records + changes.size() > limit;
+        if (rewrite) {
+            entries = dedup_index->entries();
+        }
+    }
+
+    // La instantánea ya incluye los cambios recogidos, así que no hace falta añadirlos
+    if (rewrite) {
+        if (dedup_descriptor >= 0) {
+            close(dedup_descriptor);
+            dedup_descriptor = -1;
+        }
+        if (!DedupIndex::writeSnapshot(dedup_path, entries)) {
+            std::cerr << "Error guardando el índice de deduplicación\n";
+            return;
+        }
+        dedup_journal_records = 0;
+        dedup_descriptor = open(dedup_path.c_str(), O_WRONLY | O_APPEND);
+        return;
+    }
+    if (changes.empty()) {
+        return;
+    }
+    if (!DedupIndex::appendChanges(dedup_descriptor, changes)) {
+        // El diario puede haber quedado a medias: el próximo vaciado reescribe la instantánea
+        std::cerr << "Error guardando el índice de deduplicación\n";
+        close(dedup_descriptor);
+        dedup_descriptor = -1;
+        return;
+    }
+    dedup_journal_records += changes.size();
+}
+
+void BlockManager::addReference(size_t block_index) {
+    std::lock_guard<std::mutex> lock(state_mutex);
     if (block_index < total_blocks) {
-        block_map[block_index] = false;
+        // Un bloque referenciado siempre debe figurar como usado
+        ref_counts[block_index]++;
+        setUsedLocked(block_index);
+    }
+}
+
+void BlockManager::releaseReference(size_t block_index) {
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        if (block_index >= total_blocks || ref_counts[block_index] == 0) {
+            return;
+        }
+        if (--ref_counts[block_index] > 0) {
+            return;
+        }
+        if (block_map.test(block_index)) {
+            punchHolesLocked({block_index});
+            clearUsedLocked(block_index);
+        }
+    }
+    if (cache) {
+        cache->invalidate(block_index);
+    }
+}
+
+size_t BlockManager::getReferenceCount(size_t block_index) const {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    return block_index < total_blocks ? ref_counts[block_index] : 0;
+}
+
+void BlockManager::clearReferences() {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    std::fill(ref_counts.begin(), ref_counts.end(), 0);
+}
+
+size_t BlockManager::freeUnreferenced() {
+    std::vector<size_t> freed;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        for (size_t block = 0; block < total_blocks; block++) {
+            // Los huecos de bloques comprimidos no tienen referencias de versiones propias
+            bool holds_packed = compression && pack_members[block] > 0;
+            if (ref_counts[block] == 0 && !holds_packed && block_map.test(block)) {
+                freed.push_back(block);
+            }
+        }
+        punchHolesLocked(freed);
+        for (size_t block : freed) {
+            clearUsedLocked(block);
+        }
     }
+    invalidateCached(freed);
+    return freed.size();
 }
 
 void BlockManager::writeBlock(size_t block_index, const void* data, size_t size) {
@@ -100,27 +953,648 @@ void BlockManager::writeBlock(size_t block_index, const void* data, size_t size)
         return;
     }
     
-    size_t write_size = std::min(size, BLOCK_SIZE);
-    off_t offset = block_index * BLOCK_SIZE;
-    
-    lseek(file_descriptor, offset, SEEK_SET);
-    write(file_descriptor, data, write_size);
+    size_t write_size = std::min(size, block_size);
+
+    // Con compresión o sumas se trabaja con el bloque completo (el resto se rellena con ceros)
+    std::vector<char> full_block;
+    if (compression || checksumming) {
+        full_block.assign(block_size, 0);
+        std::memcpy(full_block.data(), data, write_size);
+        data = full_block.data();
+        write_size = block_size;
+    }
+    if (compression && storePacked({{block_index, full_block.data()}}).empty()) {
+        return; // guardado comprimido
+    }
+    uint32_t checksum = checksumming ? blockChecksum(full_block.data(), block_size) : 0;
+
+    writeRawBlock(block_index, static_cast<const char*>(data), write_size);
+    if (cache) {
+        cache->invalidate(block_index);
+    }
     
     // Marcar bloque como utilizado
-    block_map[block_index] = true;
+    std::lock_guard<std::mutex> lock(state_mutex);
+    setUsedLocked(block_index);
+    setChecksumLocked(block_index, checksum);
+    if (compression) {
+        releasePackedLocked(block_index);
+    }
+}
+
+bool BlockManager::writeRawBlock(size_t block_index, const char* data, size_t size) {
+    off_t offset = blockOffset(block_index);
+    
+    // E/S posicional: no se comparte el offset del descriptor entre hilos
+    if (mapped_data) {
+        std::memcpy(mapped_data + offset, data, size);
+        std::lock_guard<std::mutex> lock(state_mutex);
+        dirty_blocks.push_back(block_index);
+        return true;
+    }
+    if (buffer_pool) {
+        // O_DIRECT solo admite bloques completos desde memoria alineada: el resto se rellena con ceros
+        AlignedBufferPool::Lease lease = buffer_pool->acquire();
+        std::memcpy(lease[0], data, size);
+        std::memset(lease[0] + size, 0, block_size - size);
+        if (pwrite(data_descriptor, lease[0], block_size, offset) != static_cast<ssize_t>(block_size)) {
+            perror("Error writing block");
+            return false;
+        }
+        return true;
+    }
+    if (pwrite(data_descriptor, data, size, offset) != static_cast<ssize_t>(size)) {
+        perror("Error writing block");
+        return false;
+    }
+    return true;
+}
+
+bool BlockManager::readRawBlock(size_t block_index, char* buffer) {
+    off_t offset = blockOffset(block_index);
+    if (mapped_data) {
+        std::memcpy(buffer, mapped_data + offset, block_size);
+        return true;
+    }
+    char* target = buffer;
+    AlignedBufferPool::Lease lease;
+    if (buffer_pool && !buffer_pool->isAligned(buffer)) {
+        lease = buffer_pool->acquire();
+        target = lease[0];
+    }
+    if (pread(data_descriptor, target, block_size, offset) != static_cast<ssize_t>(block_size)) {
+        perror("Error reading block");
+        return false;
+    }
+    if (target != buffer) {
+        std::memcpy(buffer, target, block_size);
+    }
+    return true;
+}
+
+BlockManager::BlockTargets BlockManager::storePacked(BlockTargets targets) {
+    // Sin huecos la posición propia del bloque seguiría ocupando disco además del hueco compartido
+    if (!compression || !punch_holes) {
+        return targets;
+    }
+
+    struct Placement {
+        size_t block;
+        char* source;
+        PackedLocation location;
+        uint32_t checksum;
+    };
+    BlockTargets raw;
+    std::vector<Placement> placed;
+    std::vector<char> compressed(block_size);
+
+    std::lock_guard<std::mutex> pack_lock(pack_mutex);
+    size_t unwritten = 0;       // Primera colocación cuyo hueco aún no se ha escrito
+    std::vector<size_t> sealed; // Huecos cerrados en esta llamada (su fijación se suelta al publicar)
+
+    // Escribir la imagen del hueco abierto; si falla, sus bloques se guardan sin comprimir
+    auto writeOpenSlot = [&]() {
+        if (unwritten == placed.size()) {
+            return;
+        }
+        if (!writeRawBlock(open_slot, open_slot_image.data(), block_size)) {
+            for (size_t i = unwritten; i < placed.size(); i++) {
+                raw.push_back({placed[i].block, placed[i].source});
+            }
+            placed.resize(unwritten);
+        }
+        unwritten = placed.size();
+    };
+
+    for (const auto& [block_index, source] : targets) {
+        size_t length = BlockCompressor::compress(source, block_size, compressed.data(), packLimit(block_size));
+        if (length == 0) {
+            raw.push_back({block_index, source});
+            continue;
+        }
+
+        if (open_slot == BlockBitmap::npos || open_slot_fill + length > block_size) {
+            // Cerrar el hueco lleno y abrir otro
+            writeOpenSlot();
+            std::lock_guard<std::mutex> lock(state_mutex);
+            size_t fresh = allocateLocked();
+            if (fresh == BlockBitmap::npos) {
+                raw.push_back({block_index, source});
+                continue;
+            }
+            // El hueco abierto lleva un miembro extra que lo fija mientras se llena, para que
+            // nadie lo libere aunque se suelten todos sus bloques antes de publicar los nuevos
+            if (open_slot != BlockBitmap::npos) {
+                sealed.push_back(open_slot);
+            }
+            open_slot = fresh;
+            open_slot_fill = 0;
+            open_slot_image.assign(block_size, 0);
+            pack_members[fresh] = 1;
+            pack_slots++;
+        }
+
+        std::memcpy(open_slot_image.data() + open_slot_fill, compressed.data(), length);
+        placed.push_back({block_index, source,
+                          PackedLocation{open_slot, static_cast<uint32_t>(open_slot_fill), static_cast<uint32_t>(length)},
+                          checksumming ? blockChecksum(source, block_size) : 0});
+        open_slot_fill += length;
+    }
+    writeOpenSlot();
+
+    // Publicar las ubicaciones una vez escritos los huecos. Las copias anteriores se
+    // sueltan al final para no vaciar un hueco que acaba de recibir bloques nuevos.
+    std::vector<size_t> published;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        std::vector<PackedLocation> previous_locations;
+        for (const Placement& placement : placed) {
+            PackedLocation& entry = packed_map[placement.block];
+            if (entry.length > 0) {
+                previous_locations.push_back(entry);
+                packed_blocks--;
+                packed_bytes -= entry.length;
+            }
+            entry = placement.location;
+            markPackMapDirty(placement.block);
+            pack_members[placement.location.slot]++;
+            packed_blocks++;
+            packed_bytes += placement.location.length;
+            setUsedLocked(placement.block);
+            setChecksumLocked(placement.block, placement.checksum);
+            published.push_back(placement.block);
+        }
+        for (const PackedLocation& location : previous_locations) {
+            dropPackMemberLocked(location.slot);
+        }
+        for (size_t slot : sealed) {
+            dropPackMemberLocked(slot);
+        }
+
+        // La posición propia de los bloques comprimidos ya no guarda datos
+        std::sort(published.begin(), published.end());
+        punchHolesLocked(published);
+    }
+    invalidateCached(published);
+    return raw;
+}
+
+BlockManager::BlockTargets BlockManager::loadPacked(BlockTargets targets) {
+    if (!compression) {
+        return targets;
+    }
+
+    struct PackedTarget {
+        PackedLocation location;
+        size_t block;
+        char* position;
+    };
+    BlockTargets raw;
+    std::vector<PackedTarget> packed;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        for (const auto& [block_index, position] : targets) {
+            const PackedLocation& location = packed_map[block_index];
+            if (location.length > 0) {
+                packed.push_back({location, block_index, position});
+            } else {
+                raw.push_back({block_index, position});
+            }
+        }
+    }
+
+    // Agrupar por hueco para leer cada uno una sola vez
+    std::sort(packed.begin(), packed.end(), [](const PackedTarget& a, const PackedTarget& b) {
+        return a.location.slot < b.location.slot;
+    });
+    std::vector<char> slot_data(block_size);
+    size_t loaded_slot = BlockBitmap::npos;
+    for (const PackedTarget& target : packed) {
+        if (cache && cache->lookup(target.block, target.position, block_size)) {
+            continue;
+        }
+        if (target.location.slot != loaded_slot) {
+            if (!readRawBlock(target.location.slot, slot_data.data())) {
+                continue;
+            }
+            loaded_slot = target.location.slot;
+        }
+        size_t produced = BlockCompressor::decompress(slot_data.data() + target.location.offset, target.location.length,
+                                                      target.position, block_size);
+        if (produced != block_size) {
+            std::cerr << "Error: bloque comprimido " << target.block << " corrupto\n";
+            continue;
+        }
+        if (!checkBlock(target.block, target.position)) {
+            continue;
+        }
+        if (cache) {
+            cache->insert(target.block, target.position);
+        }
+    }
+    return raw;
+}
+
+void BlockManager::releasePackedLocked(size_t block_index) {
+    PackedLocation& entry = packed_map[block_index];
+    if (entry.length == 0) {
+        return;
+    }
+    size_t slot = entry.slot;
+    packed_blocks--;
+    packed_bytes -= entry.length;
+    entry = PackedLocation{0, 0, 0};
+    markPackMapDirty(block_index);
+    dropPackMemberLocked(slot);
+}
+
+void BlockManager::dropPackMemberLocked(size_t slot) {
+    // El último miembro libera el hueco (el abierto nunca llega a cero por su fijación)
+    if (--pack_members[slot] == 0) {
+        pack_slots--;
+        punchHolesLocked({slot});
+        clearUsedLocked(slot);
+    }
 }
 
 void BlockManager::readBlock(size_t block_index, void* buffer, size_t size) {
+    if (block_index == HOLE_BLOCK) {
+        std::memset(buffer, 0, std::min(size, block_size));
+        return;
+    }
     if (block_index >= total_blocks) {
         std::cerr << "Índice de bloque fuera de rango\n";
         return;
     }
     
-    size_t read_size = std::min(size, BLOCK_SIZE);
-    off_t offset = block_index * BLOCK_SIZE;
+    size_t read_size = std::min(size, block_size);
+    off_t offset = blockOffset(block_index);
+
+    if (compression) {
+        std::vector<char> block(block_size);
+        if (loadPacked({{block_index, block.data()}}).empty()) {
+            std::memcpy(buffer, block.data(), read_size);
+            return;
+        }
+    }
     
-    lseek(file_descriptor, offset, SEEK_SET);
-    read(file_descriptor, buffer, read_size);
+    if (mapped_data) {
+        checkBlock(block_index, mapped_data + offset);
+        std::memcpy(buffer, mapped_data + offset, read_size);
+        return;
+    }
+    if (!cache && !buffer_pool && !verify_reads) {
+        if (pread(data_descriptor, buffer, read_size, offset) < 0) {
+            perror("Error reading block");
+        }
+        return;
+    }
+
+    // Con caché: servir el acierto o leer el bloque completo y guardarlo.
+    // Con O_DIRECT el bloque se lee en un buffer alineado del pool.
+    // La suma se comprueba sobre el bloque completo y uno dañado no entra en la caché.
+    if (cache && cache->lookup(block_index, buffer, read_size)) {
+        return;
+    }
+    std::vector<char> local_block;
+    char* block;
+    AlignedBufferPool::Lease lease;
+    if (buffer_pool) {
+        lease = buffer_pool->acquire();
+        block = lease[0];
+    } else {
+        local_block.resize(block_size);
+        block = local_block.data();
+    }
+    if (pread(data_descriptor, block, block_size, offset) != static_cast<ssize_t>(block_size)) {
+        perror("Error reading block");
+        return;
+    }
+    if (checkBlock(block_index, block) && cache) {
+        cache->insert(block_index, block);
+    }
+    std::memcpy(buffer, block, read_size);
+}
+
+void BlockManager::readBlocks(const std::vector<size_t>& block_indices, void* buffer) {
+    zeroHoles(block_indices, static_cast<char*>(buffer));
+    BlockTargets targets = loadPacked(layoutBlocks(block_indices, static_cast<char*>(buffer)));
+    if (!cache) {
+        transferRuns(buildRuns(targets), false);
+        checkBlocks(targets);
+        return;
+    }
+
+    // Leer del disco solo los bloques que no están en caché
+    BlockTargets misses;
+    for (const auto& [block_index, position] : targets) {
+        if (!cache->lookup(block_index, position, block_size)) {
+            misses.push_back({block_index, position});
+        }
+    }
+    transferRuns(buildRuns(misses), false);
+    for (const auto& [block_index, position] : misses) {
+        if (checkBlock(block_index, position)) {
+            cache->insert(block_index, position);
+        }
+    }
+}
+
+void BlockManager::writeBlocks(const std::vector<size_t>& block_indices, const void* data) {
+    // En modo escritura el buffer no se modifica. Los bloques que comprimen bien se empaquetan.
+    BlockTargets targets = storePacked(layoutBlocks(block_indices, const_cast<char*>(static_cast<const char*>(data))));
+    std::vector<size_t> raw_blocks;
+    std::vector<uint32_t> block_checksums;
+    for (const auto& target : targets) {
+        raw_blocks.push_back(target.first);
+        block_checksums.push_back(checksumming ? blockChecksum(target.second, block_size) : 0);
+    }
+    transferRuns(buildRuns(std::move(targets)), true);
+    invalidateCached(raw_blocks);
+
+    // Marcar bloques como utilizados
+    std::lock_guard<std::mutex> lock(state_mutex);
+    for (size_t i = 0; i < raw_blocks.size(); i++) {
+        size_t block_index = raw_blocks[i];
+        setUsedLocked(block_index);
+        setChecksumLocked(block_index, block_checksums[i]);
+        if (compression) {
+            releasePackedLocked(block_index);
+        }
+        if (mapped_data) {
+            dirty_blocks.push_back(block_index);
+        }
+    }
+}
+
+BlockManager::BlockTargets BlockManager::layoutBlocks(const std::vector<size_t>& block_indices, char* buffer) const {
+    BlockTargets targets;
+    targets.reserve(block_indices.size());
+    for (size_t i = 0; i < block_indices.size(); i++) {
+        if (block_indices[i] == HOLE_BLOCK) {
+            continue;
+        }
+        if (block_indices[i] >= total_blocks) {
+            std::cerr << "Índice de bloque fuera de rango\n";
+            continue;
+        }
+        targets.push_back({block_indices[i], buffer + i * block_size});
+    }
+    return targets;
+}
+
+void BlockManager::zeroHoles(const std::vector<size_t>& block_indices, char* buffer) const {
+    for (size_t i = 0; i < block_indices.size(); i++) {
+        if (block_indices[i] == HOLE_BLOCK) {
+            std::memset(buffer + i * block_size, 0, block_size);
+        }
+    }
+}
+
+bool BlockManager::isZeroBlock(const void* data, size_t size) {
+    return zeroKernel()(static_cast<const char*>(data), size);
+}
+
+std::vector<BlockManager::IoRun> BlockManager::buildRuns(BlockTargets targets) const {
+    // Ordenar por bloque físico para detectar rachas contiguas
+    std::sort(targets.begin(), targets.end());
+
+    size_t max_segments = buffer_pool ? std::min<size_t>(IOV_MAX, buffer_pool->capacity()) : IOV_MAX;
+    std::vector<IoRun> runs;
+    size_t i = 0;
+    while (i < targets.size()) {
+        // Racha de bloques físicos consecutivos, limitada a IOV_MAX segmentos
+        IoRun run;
+        run.offset = blockOffset(targets[i].first);
+        do {
+            run.segments.push_back({targets[i].second, block_size});
+            i++;
+        } while (i < targets.size() && targets[i].first == targets[i - 1].first + 1 && run.segments.size() < max_segments);
+        runs.push_back(std::move(run));
+    }
+    return runs;
+}
+
+void BlockManager::prepareBounce(IoRun& run, bool is_write) {
+    if (!buffer_pool) {
+        return;
+    }
+    size_t unaligned = 0;
+    for (const auto& segment : run.segments) {
+        if (!buffer_pool->isAligned(segment.iov_base)) {
+            unaligned++;
+        }
+    }
+    if (unaligned == 0) {
+        return;
+    }
+
+    run.bounce = std::make_shared<AlignedBufferPool::Lease>(buffer_pool->acquire(unaligned));
+    size_t next = 0;
+    for (auto& segment : run.segments) {
+        if (buffer_pool->isAligned(segment.iov_base)) {
+            continue;
+        }
+        char* target = static_cast<char*>(segment.iov_base);
+        char* bounce = (*run.bounce)[next++];
+        if (is_write) {
+            std::memcpy(bounce, target, block_size);
+        }
+        run.copies.push_back({bounce, target});
+        segment.iov_base = bounce;
+    }
+}
+
+void BlockManager::finishBounce(IoRun& run, bool is_write) {
+    if (!is_write) {
+        for (const auto& [bounce, target] : run.copies) {
+            std::memcpy(target, bounce, block_size);
+        }
+    }
+    run.copies.clear();
+    run.bounce.reset();
+}
+
+void BlockManager::transferRuns(std::vector<IoRun> runs, bool is_write) {
+    for (IoRun& run : runs) {
+        if (mapped_data) {
+            char* block = mapped_data + run.offset;
+            for (const auto& segment : run.segments) {
+                if (is_write) {
+                    std::memcpy(block, segment.iov_base, block_size);
+                } else {
+                    std::memcpy(segment.iov_base, block, block_size);
+                }
+                block += block_size;
+            }
+            continue;
+        }
+
+        prepareBounce(run, is_write);
+        const auto& iov = run.segments;
+        ssize_t expected = static_cast<ssize_t>(iov.size() * block_size);
+        ssize_t done = is_write ? pwritev(data_descriptor, iov.data(), iov.size(), run.offset)
+                                : preadv(data_descriptor, iov.data(), iov.size(), run.offset);
+        if (done != expected) {
+            // Transferencia parcial o error: repetir la racha bloque a bloque
+            for (size_t j = 0; j < iov.size(); j++) {
+                off_t block_offset = run.offset + j * block_size;
+                ssize_t result = is_write ? pwrite(data_descriptor, iov[j].iov_base, block_size, block_offset)
+                                          : pread(data_descriptor, iov[j].iov_base, block_size, block_offset);
+                if (result < 0) {
+                    perror(is_write ? "Error writing block" : "Error reading block");
+                }
+            }
+        }
+        finishBounce(run, is_write);
+    }
+}
+
+std::future<bool> BlockManager::readBlocksAsync(const std::vector<size_t>& block_indices, void* buffer) {
+    // Sin motor asíncrono (backend mapeado): la copia es inmediata
+    if (!async_io) {
+        readBlocks(block_indices, buffer);
+        std::promise<bool> ready;
+        ready.set_value(true);
+        return ready.get_future();
+    }
+
+    zeroHoles(block_indices, static_cast<char*>(buffer));
+    BlockTargets targets = loadPacked(layoutBlocks(block_indices, static_cast<char*>(buffer)));
+    if (!cache) {
+        if (!verify_reads) {
+            return transferRunsAsync(buildRuns(std::move(targets)), false);
+        }
+        auto pending = std::make_shared<BlockTargets>(std::move(targets));
+        return transferRunsAsync(buildRuns(*pending), false, [this, pending]() {
+            return checkBlocks(*pending);
+        });
+    }
+
+    // Enviar solo los fallos de caché y guardarlos al completarse (si su suma coincide)
+    auto misses = std::make_shared<BlockTargets>();
+    for (const auto& [block_index, position] : targets) {
+        if (!cache->lookup(block_index, position, block_size)) {
+            misses->push_back({block_index, position});
+        }
+    }
+    return transferRunsAsync(buildRuns(*misses), false, [this, misses]() {
+        bool intact = true;
+        for (const auto& [block_index, position] : *misses) {
+            if (checkBlock(block_index, position)) {
+                cache->insert(block_index, position);
+            } else {
+                intact = false;
+            }
+        }
+        return intact;
+    });
+}
+
+std::future<bool> BlockManager::writeBlocksAsync(const std::vector<size_t>& block_indices, const void* data) {
+    if (!async_io) {
+        writeBlocks(block_indices, data);
+        std::promise<bool> ready;
+        ready.set_value(true);
+        return ready.get_future();
+    }
+
+    // Los bloques que comprimen bien se empaquetan ya; el resto se envía al motor asíncrono
+    char* buffer = const_cast<char*>(static_cast<const char*>(data));
+    BlockTargets targets = storePacked(layoutBlocks(block_indices, buffer));
+    std::vector<size_t> written;
+    std::vector<uint32_t> block_checksums;
+    for (const auto& target : targets) {
+        written.push_back(target.first);
+        block_checksums.push_back(checksumming ? blockChecksum(target.second, block_size) : 0);
+    }
+
+    // Marcar bloques como utilizados al enviar (ya estaban reservados por el asignador)
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        for (size_t i = 0; i < written.size(); i++) {
+            size_t block_index = written[i];
+            setUsedLocked(block_index);
+            setChecksumLocked(block_index, block_checksums[i]);
+            if (compression) {
+                releasePackedLocked(block_index);
+            }
+        }
+    }
+    return transferRunsAsync(buildRuns(std::move(targets)), true, [this, written]() {
+        invalidateCached(written);
+        return true;
+    });
+}
+
+std::future<bool> BlockManager::transferRunsAsync(std::vector<IoRun> runs, bool is_write,
+                                                  std::function<bool()> on_success) {
+    // Estado compartido por todas las rachas de la operación
+    struct Batch {
+        std::atomic<size_t> pending;
+        std::atomic<bool> ok;
+        std::function<bool()> on_success;
+        std::promise<bool> done;
+    };
+
+    auto batch = std::make_shared<Batch>();
+    batch->pending = runs.size();
+    batch->ok = true;
+    batch->on_success = std::move(on_success);
+    std::future<bool> result = batch->done.get_future();
+    if (runs.empty()) {
+        bool ok = !batch->on_success || batch->on_success();
+        batch->done.set_value(ok);
+        return result;
+    }
+
+    AsyncIO::Operation op = is_write ? AsyncIO::Operation::Write : AsyncIO::Operation::Read;
+    for (IoRun& run : runs) {
+        // Con O_DIRECT puede esperar a que otras peticiones devuelvan sus buffers al pool
+        prepareBounce(run, is_write);
+        auto bounce = std::make_shared<IoRun>();
+        bounce->bounce = std::move(run.bounce);
+        bounce->copies = std::move(run.copies);
+
+        ssize_t expected = static_cast<ssize_t>(run.segments.size() * block_size);
+        async_io->submit(op, std::move(run.segments), run.offset,
+                         [this, batch, expected, bounce, is_write](ssize_t transferred) {
+            if (transferred != expected) {
+                batch->ok = false;
+            }
+            finishBounce(*bounce, is_write || transferred != expected);
+            if (--batch->pending == 0) {
+                if (batch->ok && batch->on_success && !batch->on_success()) {
+                    batch->ok = false;
+                }
+                batch->done.set_value(batch->ok);
+            }
+        });
+    }
+    return result;
+}
+
+void BlockManager::invalidateCached(const std::vector<size_t>& block_indices) {
+    if (!cache) {
+        return;
+    }
+    for (size_t block_index : block_indices) {
+        cache->invalidate(block_index);
+    }
+}
+
+const char* BlockManager::blockData(size_t block_index) const {
+    if (!mapped_data || block_index >= total_blocks) {
+        return nullptr;
+    }
+    if (compression) {
+        // Un bloque comprimido no tiene sus bytes en su posición
+        std::lock_guard<std::mutex> lock(state_mutex);
+        if (packed_map[block_index].length > 0) {
+            return nullptr;
+        }
+    }
+    return mapped_data + blockOffset(block_index);
 }
 
 size_t BlockManager::getTotalBlocks() const {
@@ -128,24 +1602,170 @@ size_t BlockManager::getTotalBlocks() const {
 }
 
 bool BlockManager::isBlockUsed(size_t block_index) const {
-    auto it = block_map.find(block_index);
-    return (it != block_map.end()) && it->second;
+    return block_map.test(block_index);
 }
 
 // Implementación del nuevo método para estadísticas de memoria
 BlockManager::MemoryUsage BlockManager::getMemoryUsage() const {
     MemoryUsage usage;
     usage.total_blocks = total_blocks;
-    usage.used_blocks = std::count_if(block_map.begin(), block_map.end(), 
-                                    [](const auto& p) { return p.second; });
+    usage.used_blocks = block_map.count();
     usage.free_blocks = total_blocks - usage.used_blocks;
-    usage.total_bytes = total_blocks * BLOCK_SIZE;
-    usage.used_bytes = usage.used_blocks * BLOCK_SIZE;
+    usage.total_bytes = total_blocks * block_size;
+    usage.used_bytes = usage.used_blocks * block_size;
+    usage.max_blocks = max_blocks;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        usage.dedup_entries = dedup_index ? dedup_index->size() : 0;
+        usage.dedup_hits = dedup_hits;
+        usage.packed_blocks = packed_blocks;
+        usage.packed_bytes = packed_bytes;
+        usage.pack_slots = pack_slots;
+    }
+    usage.checksums = checksumming;
+    usage.checksum_failures = checksum_failures;
+    usage.allocation_groups = block_map.activeGroups();
+    usage.group_blocks = block_map.groupSize();
+    struct stat info;
+    usage.disk_bytes = fstat(file_descriptor, &info) == 0 ? static_cast<size_t>(info.st_blocks) * 512 : 0;
+    usage.io_buffer_bytes = buffer_pool ? buffer_pool->capacity() * buffer_pool->bufferSize() : 0;
+    usage.cache = cache ? cache->getStats() : BlockCache::Stats{0, 0, 0, 0, 0};
     return usage;
 }
 
 void BlockManager::sync() {
+    if (async_io) {
+        async_io->drain();
+    }
+    if (mapped_data) {
+        flushDirtyRanges();
+    }
+    // Escribir solo las páginas del mapa de bits y de la tabla que cambiaron y hacer un único fsync
+    flushRegions();
     fsync(file_descriptor);
-    // También guardar mapa de bloques
-    saveBlockMap();
-}
\ No newline at end of file
+    flushDedupIndex();
+}
+
+bool BlockManager::blockMatches(size_t block_index, uint32_t expected) {
+    PackedLocation location{0, 0, 0};
+    if (compression) {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        location = packed_map[block_index];
+    }
+
+    // Leer lo que hay en disco, sin la caché: un bloque comprimido se descomprime desde su hueco
+    std::vector<char> block(block_size);
+    if (location.length > 0) {
+        std::vector<char> slot_data(block_size);
+        if (!readRawBlock(location.slot, slot_data.data()) ||
+            BlockCompressor::decompress(slot_data.data() + location.offset, location.length, block.data(),
+                                        block_size) != block_size) {
+            return false;
+        }
+    } else if (!readRawBlock(block_index, block.data())) {
+        return false;
+    }
+    return blockChecksum(block.data(), block_size) == expected;
+}
+
+bool BlockManager::verifyBlock(size_t block_index) {
+    uint32_t expected;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        if (!checksumming || block_index >= total_blocks || !block_map.test(block_index)) {
+            return true;
+        }
+        expected = checksums[block_index].load(std::memory_order_relaxed);
+    }
+    return expected == 0 || blockMatches(block_index, expected);
+}
+
+bool BlockManager::startScrub(size_t blocks_per_second) {
+    if (!checksumming) {
+        return false;
+    }
+    std::lock_guard<std::mutex> control(scrub_control);
+    {
+        std::lock_guard<std::mutex> lock(scrub_mutex);
+        if (scrub_status.running) {
+            return false;
+        }
+    }
+    // Recoger el hilo de una pasada anterior ya terminada
+    if (scrub_thread.joinable()) {
+        scrub_thread.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(scrub_mutex);
+        scrub_status = ScrubStatus{true, 0, total_blocks, 0, {}};
+        scrub_stop = false;
+    }
+    scrub_thread = std::thread(&BlockManager::scrubLoop, this, blocks_per_second);
+    return true;
+}
+
+void BlockManager::stopScrub() {
+    std::lock_guard<std::mutex> control(scrub_control);
+    {
+        std::lock_guard<std::mutex> lock(scrub_mutex);
+        scrub_stop = true;
+    }
+    scrub_wake.notify_all();
+    if (scrub_thread.joinable()) {
+        scrub_thread.join();
+    }
+}
+
+BlockManager::ScrubStatus BlockManager::getScrubStatus() const {
+    std::lock_guard<std::mutex> lock(scrub_mutex);
+    return scrub_status;
+}
+
+void BlockManager::scrubLoop(size_t blocks_per_second) {
+    auto start = std::chrono::steady_clock::now();
+    size_t end;
+    {
+        std::lock_guard<std::mutex> lock(scrub_mutex);
+        end = scrub_status.total;
+    }
+
+    size_t verified = 0;
+    for (size_t block = 0; block < end; block++) {
+        uint32_t expected = 0;
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+            if (block_map.test(block)) {
+                expected = checksums[block].load(std::memory_order_relaxed);
+            }
+        }
+
+        bool intact = true;
+        if (expected != 0) {
+            intact = blockMatches(block, expected);
+            if (!intact) {
+                // Un bloque liberado o reescrito mientras se leía no cuenta como dañado
+                std::lock_guard<std::mutex> lock(state_mutex);
+                intact = !block_map.test(block) || checksums[block].load(std::memory_order_relaxed) != expected;
+            }
+            verified++;
+        }
+
+        std::unique_lock<std::mutex> lock(scrub_mutex);
+        scrub_status.position = block + 1;
+        scrub_status.verified = verified;
+        if (!intact) {
+            scrub_status.corrupt.push_back(block);
+        }
+        // Limitar el ritmo: el bloque n no se revisa antes de start + n / blocks_per_second
+        if (expected != 0 && blocks_per_second > 0) {
+            auto deadline = start + std::chrono::microseconds(verified * 1000000 / blocks_per_second);
+            scrub_wake.wait_until(lock, deadline, [this]() { return scrub_stop; });
+        }
+        if (scrub_stop) {
+            break;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(scrub_mutex);
+    scrub_status.running = false;
+}
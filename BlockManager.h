@@ -1,36 +1,275 @@
 #pragma once
-#include <unordered_map>
 #include <string>
+#include <vector>
 #include <cstdlib>
+#include <mutex>
+#include <memory>
+#include <future>
+#include <atomic>
+#include <type_traits>
+#include <thread>
+#include <condition_variable>
+#include <sys/uio.h>
+#include "BlockBitmap.h"
+#include "AllocationGroups.h"
+#include "AsyncIO.h"
+#include "BlockCache.h"
+#include "AlignedBufferPool.h"
+#include "DedupIndex.h"
+#include "BlockCompressor.h"
 
-// Tamaño fijo de los bloques (4 KB por defecto)
+// Tamaño de bloque por defecto. Cada almacén elige el suyo al crearse (potencia de dos
+// entre MIN_BLOCK_SIZE y MAX_BLOCK_SIZE) y lo guarda en la cabecera.
 const size_t BLOCK_SIZE = 4096;
+const size_t MIN_BLOCK_SIZE = 1024;
+const size_t MAX_BLOCK_SIZE = 64 * 1024;
+
+// Ejecutar 'body' con el tamaño de bloque como constante de compilación para los tamaños
+// habituales (std::integral_constant, que se convierte a size_t) y como valor normal para
+// el resto. Así los bucles por bloque se especializan sin duplicar el código. Según
+// bench/block_size_bench, en los bucles que recorren bloques enteros (memcmp, memcpy,
+// comprobar ceros) no se nota: están limitados por memoria, no por el tamaño conocido.
+template <typename Body>
+decltype(auto) withBlockSize(size_t block_size, Body &&body)
+{
+    switch (block_size)
+    {
+    case 1024:
+        return body(std::integral_constant<size_t, 1024>{});
+    case 4096:
+        return body(std::integral_constant<size_t, 4096>{});
+    case 16384:
+        return body(std::integral_constant<size_t, 16384>{});
+    case 65536:
+        return body(std::integral_constant<size_t, 65536>{});
+    default:
+        return body(block_size);
+    }
+}
+
+// Bloque lógico sin datos (hueco de un archivo disperso): se lee como ceros, no ocupa
+// bloque físico ni genera E/S. Distinto de npos (-1), que indica un fallo al reservar.
+const size_t HOLE_BLOCK = static_cast<size_t>(-2);
+
+// Forma de acceder al archivo de datos
+enum class StorageBackend
+{
+    FileDescriptor, // lseek + read/write sobre el descriptor
+    MemoryMapped    // mmap del archivo completo; lecturas con memcpy y sync con msync
+};
+
+// Opciones de configuración del almacén, elegidas al construirlo
+struct StorageOptions
+{
+    StorageBackend backend = StorageBackend::FileDescriptor;
+
+    // Tamaño de bloque de un almacén nuevo (los existentes usan el de su cabecera).
+    // Bloques pequeños desperdician menos en archivos pequeños; grandes reducen metadatos y E/S por byte.
+    size_t block_size = BLOCK_SIZE;
+
+    // Capacidad de la caché de bloques en bloques (0 = sin caché).
+    // Solo se usa con el backend de descriptor: con mmap los bloques ya se leen de memoria.
+    size_t cache_blocks = 256;
+
+    // Crecimiento en línea: el almacén empieza con el tamaño pedido y, al agotarse, se amplía
+    // con fallocate en pasos de growth_increment bytes hasta max_size bytes (0 = tamaño fijo).
+    // El tope se fija al crear el almacén (dimensiona la región del mapa de bits) y se guarda en la cabecera.
+    size_t growth_increment = 16 * 1024 * 1024;
+    size_t max_size = 0;
+
+    // Devolver al sistema de archivos el espacio de los bloques liberados (FALLOC_FL_PUNCH_HOLE)
+    bool punch_holes = true;
+
+    // E/S directa (O_DIRECT) para los bloques de datos con el backend de descriptor: evita
+    // la caché de páginas del kernel, de modo que la única caché es la de bloques de la aplicación.
+    // Los buffers del llamador que no estén alineados al tamaño de bloque pasan por un pool fijo
+    // de direct_buffers buffers alineados. Si el sistema de archivos no lo admite se ignora.
+    bool direct_io = false;
+    size_t direct_buffers = 64;
+
+    // Deduplicación por contenido: índice huella -> bloque físico para reutilizar bloques
+    // idénticos entre archivos y versiones. Se guarda junto al almacén en <ruta>.dedup como una
+    // instantánea más un diario: cada sync añade solo los cambios, y la instantánea se reescribe
+    // cuando el diario supera el doble del índice.
+    bool dedup = false;
+
+    // Compresión transparente: los bloques que comprimen bien se guardan empaquetados en
+    // huecos físicos compartidos y una tabla indica dónde está cada uno. Se fija al crear
+    // el almacén (reserva la tabla en storage.bin). El índice de un bloque comprimido sigue
+    // reservado (es el que guardan las versiones) y cada hueco ocupa otro, así que la compresión
+    // no devuelve capacidad al asignador: el ahorro es espacio en disco, que vuelve al sistema de
+    // archivos perforando la posición propia de cada bloque empaquetado. Por eso requiere
+    // punch_holes: sin él no se crea un almacén comprimido, y si los huecos dejan de estar
+    // disponibles (el sistema de archivos no los admite) los bloques nuevos se guardan sin comprimir.
+    bool compression = false;
+
+    // Sumas CRC32C por bloque, guardadas en su propia región de storage.bin. Se fijan al
+    // crear el almacén; verify_reads comprueba cada bloque que se lee del disco (no los
+    // aciertos de caché) y se puede desactivar sin perder las sumas.
+    bool checksums = true;
+    bool verify_reads = true;
+
+    // Grupos de asignación: el espacio se reparte en este número de grupos, cada uno con su
+    // propio mapa y su propio mutex. Cada hilo reserva en su grupo (o en el del bloque anterior
+    // del archivo) y solo toma bloques de otros grupos cuando el suyo no tiene sitio.
+    // Solo afecta a la memoria: el mapa de bits en disco no cambia.
+    size_t allocation_groups = 16;
+};
+
+// Concurrencia:
+// - readBlock, writeBlock, readBlocks, writeBlocks, sus variantes asíncronas y blockData pueden llamarse desde varios hilos a la vez:
+//   la E/S es posicional (pread/pwrite o memcpy sobre el mapeo) y no comparte offset.
+//   Escribir y leer el MISMO bloque a la vez no está sincronizado (en COW un bloque
+//   no se vuelve a escribir una vez publicado en una versión).
+// - allocateBlock, allocateExtent (que pueden ampliar el almacén), freeBlock, los métodos de referencias, isBlockUsed, getMemoryUsage y sync
+//   protegen el estado del asignador con un mutex interno y también son seguros. La reserva solo toma el
+//   mutex del grupo de asignación en el que busca; el mutex general únicamente para ampliar el almacén.
+// - startScrub/stopScrub no deben llamarse a la vez desde varios hilos; getScrubStatus sí.
+// - El constructor y el destructor no deben solaparse con ninguna otra llamada.
+// Cabecera guardada al inicio de storage.bin (formato versionado)
+struct Superblock
+{
+    uint64_t magic;          // "COWSTORE"
+    uint32_t format_version; // Versión del formato en disco
+    uint32_t block_size;     // Tamaño de bloque del almacén
+    uint64_t total_blocks;   // Bloques de datos
+    uint64_t bitmap_offset;  // Offset de la región del mapa de bits
+    uint64_t bitmap_bytes;   // Tamaño de la región del mapa (múltiplo de block_size)
+    uint64_t data_offset;    // Offset del bloque de datos 0
+    uint64_t max_blocks;     // Tope de crecimiento (formato 2; 0 en el formato 1 = total_blocks)
+    uint64_t packmap_offset; // Tabla de bloques comprimidos (formato 3; 0 = sin compresión)
+    uint64_t packmap_bytes;
+    uint64_t checksum_offset; // Sumas CRC32C por bloque (formato 4; 0 = sin sumas)
+    uint64_t checksum_bytes;
+};
+
+// Entrada de la tabla de compresión: bytes comprimidos de un bloque dentro de un hueco
+// compartido. length == 0 indica que el bloque está guardado sin comprimir en su posición.
+struct PackedLocation
+{
+    uint64_t slot;
+    uint32_t offset;
+    uint32_t length;
+};
 
 class BlockManager
 {
 public:
-// Constructor que recibe ruta del archivo y tamaño total
-BlockManager(const char *file_path, size_t total_size);
+// Constructor que recibe ruta del archivo, tamaño total y opciones del almacén.
+// Si el mapeo en memoria falla se usa el backend de descriptor como respaldo.
+BlockManager(const char *file_path, size_t total_size, const StorageOptions &options = {});
 ~BlockManager();
 
 // Reservar un bloque libre y marcarlo como usado
 size_t allocateBlock();
 
+// Racha de bloques físicos contiguos [start, start + length)
+struct Extent
+{
+    size_t start;
+    size_t length;
+};
+
+// Reservar 'count' bloques en rachas contiguas, empezando a buscar en 'hint'.
+// Prefiere una sola racha; si no existe, devuelve varias rachas parciales.
+// Devuelve un vector vacío (sin reservar nada) si no hay espacio suficiente.
+std::vector<Extent> allocateExtent(size_t count, size_t hint = 0);
+
 // Liberar un bloque previamente asignado
 void freeBlock(size_t block_index);
 
+// Deduplicación (solo con StorageOptions::dedup).
+// findDuplicate busca un bloque en uso con exactamente el contenido 'data' (un bloque completo):
+// la huella elige el candidato y después se comparan los bytes. Devuelve npos si no hay ninguno.
+// registerContent apunta el contenido de un bloque ya escrito; la entrada se borra al liberarlo.
+bool dedupEnabled() const { return dedup_index != nullptr; }
+size_t findDuplicate(const void *data, const BlockFingerprint &fingerprint);
+void registerContent(size_t block_index, const BlockFingerprint &fingerprint);
+
+// Contadores de referencias por bloque (una referencia por cada versión que lo incluye).
+// Al soltar la última referencia el bloque vuelve inmediatamente a estar libre.
+void addReference(size_t block_index);
+void releaseReference(size_t block_index);
+size_t getReferenceCount(size_t block_index) const;
+
+// Poner todos los contadores a cero sin liberar bloques (antes de recargar metadatos)
+void clearReferences();
+
+// Liberar los bloques marcados como usados que no tienen ninguna referencia
+// (p. ej. reservados por una escritura que nunca llegó a publicarse). Devuelve cuántos liberó.
+size_t freeUnreferenced();
+
 // Escribir datos en un bloque específico
 void writeBlock(size_t block_index, const void *data, size_t size);
 
 // Leer datos desde un bloque específico
 void readBlock(size_t block_index, void *buffer, size_t size);
 
+// Leer varios bloques en un buffer contiguo de block_indices.size() * getBlockSize() bytes.
+// Los bloques físicamente adyacentes se agrupan en una sola llamada preadv.
+// Las entradas HOLE_BLOCK se rellenan con ceros (también en readBlock y readBlocksAsync).
+void readBlocks(const std::vector<size_t> &block_indices, void *buffer);
+
+// Escribir varios bloques desde un buffer contiguo (mismo formato que readBlocks),
+// agrupando los bloques físicamente adyacentes en una sola llamada pwritev
+void writeBlocks(const std::vector<size_t> &block_indices, const void *data);
+
+// Versiones asíncronas de readBlocks/writeBlocks: envían todas las rachas al motor
+// de E/S sin bloquear y el future indica si todas se completaron bien.
+// El buffer debe seguir vivo hasta que el future esté listo.
+std::future<bool> readBlocksAsync(const std::vector<size_t> &block_indices, void *buffer);
+std::future<bool> writeBlocksAsync(const std::vector<size_t> &block_indices, const void *data);
+
+// Puntero directo al contenido de un bloque (solo con backend mapeado; nullptr en otro caso)
+const char *blockData(size_t block_index) const;
+
+// Indica si 'size' bytes son todos cero (con AVX2 si la CPU lo tiene)
+static bool isZeroBlock(const void *data, size_t size);
+
+// Indica si el almacén guarda bloques comprimidos
+bool usingCompression() const { return compression; }
+
+// Indica si el almacén guarda sumas de verificación de los bloques
+bool usingChecksums() const { return checksumming; }
+
+// Releer un bloque del disco (sin pasar por la caché) y comprobar su suma.
+// Devuelve true si coincide o si el bloque está libre o no tiene suma.
+bool verifyBlock(size_t block_index);
+
+// Revisión en segundo plano: un hilo recorre una vez todos los bloques en uso con suma,
+// a como mucho 'blocks_per_second' bloques por segundo (0 = sin límite), y anota los que
+// no coinciden. Devuelve false si ya hay una revisión en marcha o el almacén no tiene sumas.
+struct ScrubStatus
+{
+    bool running;
+    size_t position;             // Siguiente índice de bloque a revisar
+    size_t total;                // Bloques del almacén al empezar la pasada
+    size_t verified;             // Bloques comprobados
+    std::vector<size_t> corrupt; // Bloques cuya suma no coincide
+};
+
+bool startScrub(size_t blocks_per_second = 0);
+void stopScrub();
+ScrubStatus getScrubStatus() const;
+
+// Backend efectivamente en uso
+StorageBackend getBackend() const { return backend; }
+
+// Indica si los bloques de datos se leen y escriben con O_DIRECT
+bool usingDirectIO() const { return buffer_pool != nullptr; }
+
 // Sincronizar cambios a disco
 void sync();
 
-// Obtener número total de bloques
+// Tamaño de bloque del almacén (fijado al crearlo)
+size_t getBlockSize() const { return block_size; }
+
+// Obtener número total de bloques (crece si el almacén se amplía)
 size_t getTotalBlocks() const;
 
+// Tope de bloques hasta el que puede crecer el almacén
+size_t getMaxBlocks() const { return max_blocks; }
+
 // Verificar si un bloque está en uso
 bool isBlockUsed(size_t block_index) const;
 
@@ -42,21 +281,231 @@ bool isBlockUsed(size_t block_index) const;
       size_t free_blocks;
       size_t total_bytes;
       size_t used_bytes;
+      size_t max_blocks;  // Tope de crecimiento (igual a total_blocks si el tamaño es fijo)
+      size_t disk_bytes;  // Espacio realmente ocupado en el sistema de archivos (sin huecos)
+      size_t io_buffer_bytes; // Memoria fija del pool de buffers alineados (0 sin O_DIRECT)
+      size_t dedup_entries;   // Bloques registrados en el índice de deduplicación
+      size_t dedup_hits;      // Bloques reutilizados por contenido en lugar de escribirse
+      size_t packed_blocks;   // Bloques guardados comprimidos
+      size_t packed_bytes;    // Bytes comprimidos de esos bloques
+      size_t pack_slots;      // Bloques físicos que los contienen
+      bool checksums;         // El almacén guarda sumas CRC32C
+      size_t checksum_failures; // Lecturas cuya suma no coincidió
+      size_t allocation_groups; // Grupos de asignación con bloques
+      size_t group_blocks;      // Bloques por grupo
+      BlockCache::Stats cache; // Estadísticas de la caché de bloques (ceros si no hay caché)
   };
 
   MemoryUsage getMemoryUsage() const;
 
 private:
 std::string data_file_path;                 // Ruta del archivo de datos
-std::string metadata_file_path;             // Ruta del archivo de metadatos
-int file_descriptor;                        // Descriptor del archivo
-size_t total_blocks;                        // Número total de bloques
-std::unordered_map<size_t, bool> block_map; // Mapa de bloques (índice, usado)
+std::string legacy_map_path;                // Ruta del mapa de bloques del formato anterior (.meta)
+int file_descriptor;                        // Descriptor del archivo (cabecera, mapa de bits, fsync)
+int data_descriptor;                        // Descriptor para los bloques de datos (con O_DIRECT si está activo)
+size_t block_size;                          // Tamaño de bloque del almacén
+std::atomic<size_t> total_blocks;           // Número total de bloques (crece bajo state_mutex)
+size_t max_blocks;                          // Tope de crecimiento
+size_t growth_blocks;                       // Incremento de crecimiento en bloques (0 = tamaño fijo)
+std::atomic<bool> punch_holes;              // Se desactiva si el sistema de archivos no lo admite
+uint64_t bitmap_offset;                     // Región del mapa de bits dentro del archivo
+uint64_t bitmap_bytes;
+uint64_t data_offset;                       // Offset del bloque de datos 0
+// Páginas (bloques) modificadas de una región persistida en storage.bin
+struct DirtyPages
+{
+    std::vector<bool> flags;
+    std::vector<size_t> pages;
+
+    void reset(size_t page_count);
+    void mark(size_t page);
+    void markAll();
+};
+
+AllocationGroups block_map;                 // Mapa de bits por grupos de asignación (1 = usado; cada grupo con su mutex)
+size_t allocation_groups;                   // Número de grupos pedido (fija el tamaño de grupo)
+StorageBackend backend;                     // Backend de acceso al archivo de datos
+char *mapped_data;                          // Región mapeada (backend MemoryMapped)
+size_t mapped_size;                         // Tamaño de la región mapeada
+std::vector<size_t> dirty_blocks;           // Bloques escritos desde el último msync
+std::vector<uint32_t> ref_counts;           // Referencias de versiones por bloque
+mutable std::mutex state_mutex;             // Protege ref_counts, dirty_blocks, las páginas sucias y el crecimiento
+std::unique_ptr<AsyncIO> async_io;          // Motor de E/S asíncrona (backend de descriptor)
+std::unique_ptr<BlockCache> cache;          // Caché de bloques (nullptr si está desactivada)
+std::unique_ptr<AlignedBufferPool> buffer_pool; // Buffers alineados para O_DIRECT (nullptr sin E/S directa)
+std::string dedup_path;                     // Archivo del índice de deduplicación
+std::unique_ptr<DedupIndex> dedup_index;    // Índice huella -> bloque (nullptr sin deduplicación; bajo state_mutex)
+std::mutex dedup_file_mutex;                // Ordena los vaciados del índice (se toma antes que state_mutex)
+int dedup_descriptor;                       // Archivo del índice abierto con O_APPEND (-1 = reescribir la instantánea)
+size_t dedup_journal_records;               // Registros del diario detrás de la instantánea
+size_t dedup_hits;
+bool compression;                           // El almacén tiene tabla de compresión
+uint64_t packmap_offset;                    // Región de la tabla de compresión (0 si no hay)
+uint64_t packmap_bytes;
+std::vector<PackedLocation> packed_map;     // Por bloque lógico: dónde están sus bytes comprimidos (bajo state_mutex)
+std::vector<uint32_t> pack_members;         // Por hueco: bloques comprimidos vivos que contiene
+DirtyPages packmap_dirty;
+size_t packed_blocks;
+size_t packed_bytes;
+size_t pack_slots;
+std::mutex pack_mutex;                      // Serializa el llenado del hueco abierto
+size_t open_slot;                           // Hueco que se está llenando (npos si ninguno; bajo pack_mutex)
+size_t open_slot_fill;                      // Bytes ocupados del hueco abierto (bajo pack_mutex)
+std::vector<char> open_slot_image;          // Contenido del hueco abierto (bajo pack_mutex)
+bool checksumming;                          // El almacén tiene región de sumas
+bool verify_reads;                          // Comprobar las sumas al leer del disco
+uint64_t checksum_offset;                   // Región de las sumas (0 si no hay)
+uint64_t checksum_bytes;
+std::vector<std::atomic<uint32_t>> checksums; // Por bloque, hasta el tope (0 = sin suma; se escriben bajo state_mutex)
+DirtyPages checksum_dirty;
+std::atomic<size_t> checksum_failures;
+std::mutex scrub_control;                   // Serializa startScrub/stopScrub
+mutable std::mutex scrub_mutex;             // Protege scrub_status y scrub_stop
+std::condition_variable scrub_wake;         // Despierta al hilo de revisión para que pare
+std::thread scrub_thread;
+ScrubStatus scrub_status;
+bool scrub_stop;
+
+// Intentar mapear el archivo de datos en memoria
+bool mapStorage();
+
+// Racha de bloques físicamente contiguos lista para una llamada vectorizada
+struct IoRun
+{
+    off_t offset;
+    std::vector<struct iovec> segments;
+
+    // Con O_DIRECT: buffers del pool que sustituyen a los segmentos no alineados
+    // y pares (buffer del pool, posición del llamador) que hay que copiar
+    std::shared_ptr<AlignedBufferPool::Lease> bounce;
+    std::vector<std::pair<char *, char *>> copies;
+};
+
+// Pares (bloque físico, posición en memoria) de una transferencia
+using BlockTargets = std::vector<std::pair<size_t, char *>>;
+
+// Asociar cada bloque a su hueco dentro de un buffer contiguo (las entradas HOLE_BLOCK se omiten)
+BlockTargets layoutBlocks(const std::vector<size_t> &block_indices, char *buffer) const;
+
+// Poner a cero las posiciones del buffer que corresponden a entradas HOLE_BLOCK
+void zeroHoles(const std::vector<size_t> &block_indices, char *buffer) const;
+
+// Agrupar los bloques, ordenados por índice físico, en rachas de como máximo IOV_MAX segmentos
+// (o la capacidad del pool con O_DIRECT, para que cada racha quepa en un préstamo)
+std::vector<IoRun> buildRuns(BlockTargets targets) const;
+
+// Transferir las rachas con preadv/pwritev (o memcpy con el backend mapeado)
+void transferRuns(std::vector<IoRun> runs, bool is_write);
+
+// Con O_DIRECT, sustituir los segmentos no alineados por buffers del pool (copiando los datos
+// si es una escritura) y, al terminar una lectura, copiar el resultado a su destino
+void prepareBounce(IoRun &run, bool is_write);
+void finishBounce(IoRun &run, bool is_write);
+
+// Enviar las rachas al motor asíncrono; 'on_success' se ejecuta antes de resolver el future
+// y, si devuelve false, el future también
+std::future<bool> transferRunsAsync(std::vector<IoRun> runs, bool is_write,
+                                    std::function<bool()> on_success = nullptr);
+
+// Descartar de la caché los bloques indicados
+void invalidateCached(const std::vector<size_t> &block_indices);
+
+// Hacer msync solo de los rangos de bloques modificados
+void flushDirtyRanges();
+
+// Offset en el archivo del bloque de datos indicado
+off_t blockOffset(size_t block_index) const { return static_cast<off_t>(data_offset + block_index * block_size); }
+
+// Calcular la disposición del archivo a partir de max_blocks
+void computeLayout();
+
+// Asegurar que el archivo cubre la cabecera y todos los bloques
+void extendFile();
+
+// Leer y validar el superbloque; false si el archivo no tiene uno
+bool loadSuperblock();
+void writeSuperblock();
+
+// Cargar el mapa de bits desde su región con una única lectura
+void loadBitmap();
+
+// Escribir solo las páginas modificadas del mapa de bits y de la tabla de compresión
+void flushRegions();
+
+// Copiar las páginas sucias de una región agrupando las contiguas (requiere state_mutex)
+using RegionRuns = std::vector<std::pair<size_t, std::vector<char>>>;
+RegionRuns collectDirtyPagesLocked(DirtyPages &dirty, const char *bytes, size_t byte_count);
+void writeRegionPages(const RegionRuns &runs, uint64_t region_offset, const char *error_message);
+
+// Cargar la tabla de compresión y reconstruir los contadores de cada hueco
+void loadPackMap();
+
+// Cargar las sumas de los bloques en uso
+void loadChecksums();
+
+// Anotar la suma de un bloque (requiere state_mutex; sin efecto si el almacén no tiene sumas)
+void setChecksumLocked(size_t block_index, uint32_t checksum);
+
+// Comprobar un bloque recién leído del disco si verify_reads está activo; avisa si no coincide
+bool checkBlock(size_t block_index, const char *data);
+bool checkBlocks(const BlockTargets &targets);
+
+// Releer el bloque del disco y compararlo con 'expected'
+bool blockMatches(size_t block_index, uint32_t expected);
+
+// Cuerpo del hilo de revisión
+void scrubLoop(size_t blocks_per_second);
+
+// Añadir al diario del índice de deduplicación los cambios desde el último vaciado (o
+// reescribir la instantánea si el diario creció demasiado). state_mutex solo se toma para
+// recoger los cambios; la escritura se hace fuera.
+void flushDedupIndex();
+
+// Copiar los bloques usados de un almacén del formato anterior (datos desde el offset 0, mapa
+// en .meta), abierto en 'legacy_descriptor', al archivo nuevo de file_descriptor
+void migrateLegacyStore(int legacy_descriptor, size_t legacy_size);
+
+// Cambiar el estado de un bloque y de lo que depende de él (requieren state_mutex)
+void setUsedLocked(size_t block_index);
+bool clearUsedLocked(size_t block_index);
+void markPackMapDirty(size_t block_index);
+void markChecksumDirty(size_t block_index);
+
+// Reservar un bloque libre ampliando el almacén si hace falta (requiere state_mutex); npos si no hay
+size_t allocateLocked();
+
+// Tamaño de grupo para el tope de crecimiento actual (múltiplo de 64)
+size_t allocationGroupSize() const;
+
+// Grupo de asignación del hilo actual (se reparten en turno rotatorio)
+size_t threadGroup() const;
+
+// Reservar un bloque libre empezando por el grupo 'home' y siguiendo por los demás, sin
+// ampliar el almacén ni tomar state_mutex; npos si todos están llenos
+size_t takeFreeBlock(size_t home);
+
+// Leer o escribir el contenido físico de un bloque sin pasar por la compresión ni la caché
+bool readRawBlock(size_t block_index, char *buffer);
+bool writeRawBlock(size_t block_index, const char *data, size_t size);
+
+// Guardar comprimidos los bloques que compensan (empaquetándolos en el hueco abierto)
+// y devolver los que deben escribirse sin comprimir
+BlockTargets storePacked(BlockTargets targets);
+
+// Servir los bloques comprimidos (leyendo cada hueco una sola vez) y devolver el resto
+BlockTargets loadPacked(BlockTargets targets);
+
+// Olvidar la copia comprimida de un bloque; libera el hueco si queda vacío (requiere state_mutex)
+void releasePackedLocked(size_t block_index);
+void dropPackMemberLocked(size_t slot);
 
-// Cargar mapa de bloques desde archivo de metadatos
-void loadBlockMap();
+// Ampliar el almacén para disponer de al menos 'needed_blocks' bloques libres más
+// (requiere state_mutex). Devuelve false si se alcanzó el tope o falla fallocate.
+bool growLocked(size_t needed_blocks);
 
-// Guardar mapa de bloques en archivo de metadatos
-void saveBlockMap();
+// Liberar en el sistema de archivos el espacio de los bloques indicados, agrupando
+// rachas contiguas (requiere state_mutex). Se llama antes de marcar los bloques como libres:
+// la reserva no toma state_mutex, así que un bloque ya libre podría reasignarse y escribirse antes del hueco.
+void punchHolesLocked(const std::vector<size_t> &block_indices);
 }
 ;
\ No newline at end of file
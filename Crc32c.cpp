@@ -0,0 +1,174 @@
+#include "Crc32c.h"
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define CRC32C_X86 1
+#endif
+
+namespace {
+constexpr uint32_t POLYNOMIAL = 0x82F63B78; // Castagnoli, representación reflejada
+
+struct Tables
+{
+    uint32_t slice[8][256];
+
+    Tables() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (POLYNOMIAL & (0u - (crc & 1)));
+            }
+            slice[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+            for (int k = 1; k < 8; k++) {
+                slice[k][i] = (slice[k - 1][i] >> 8) ^ slice[0][slice[k - 1][i] & 0xff];
+            }
+        }
+    }
+};
+
+const Tables& tables() {
+    static const Tables instance;
+    return instance;
+}
+
+uint32_t crcSoftware(uint32_t crc, const uint8_t* data, size_t size) {
+    const Tables& t = tables();
+    while (size >= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        word ^= crc;
+        crc = t.slice[7][word & 0xff] ^ t.slice[6][(word >> 8) & 0xff] ^ t.slice[5][(word >> 16) & 0xff] ^
+              t.slice[4][(word >> 24) & 0xff] ^ t.slice[3][(word >> 32) & 0xff] ^ t.slice[2][(word >> 40) & 0xff] ^
+              t.slice[1][(word >> 48) & 0xff] ^ t.slice[0][word >> 56];
+        data += 8;
+        size -= 8;
+    }
+    while (size-- > 0) {
+        crc = (crc >> 8) ^ t.slice[0][(crc ^ *data++) & 0xff];
+    }
+    return crc;
+}
+
+// Producto de dos polinomios módulo el de Castagnoli (representación reflejada: bit 31 = x^0)
+uint32_t multiplyModP(uint32_t a, uint32_t b) {
+    uint32_t mask = 1u << 31;
+    uint32_t product = 0;
+    while (true) {
+        if (a & mask) {
+            product ^= b;
+            if ((a & (mask - 1)) == 0) {
+                break;
+            }
+        }
+        mask >>= 1;
+        b = (b & 1) ? (b >> 1) ^ POLYNOMIAL : b >> 1;
+    }
+    return product;
+}
+
+// x^(8 * bytes) módulo P: multiplicar un estado por esto equivale a avanzarlo 'bytes' ceros
+uint32_t shiftOperator(size_t bytes) {
+    uint32_t power = 1u << 31;   // x^0
+    uint32_t square = 1u << 23;  // x^8 (un byte)
+    while (bytes > 0) {
+        if (bytes & 1) {
+            power = multiplyModP(square, power);
+        }
+        square = multiplyModP(square, square);
+        bytes >>= 1;
+    }
+    return power;
+}
+
+#ifdef CRC32C_X86
+// Bytes por carril en el modo de tres carriles
+constexpr size_t LANE_MIN = 256;
+
+__attribute__((target("sse4.2"))) uint32_t crcHardware(uint32_t crc, const uint8_t* data, size_t size) {
+#if defined(__x86_64__)
+    // crc32 tiene latencia 3 y rendimiento 1 por ciclo: tres carriles independientes
+    // llenan la unidad, y después se combinan desplazando los estados con un producto en GF(2)
+    if (size >= 3 * LANE_MIN) {
+        size_t lane = size / 3 / 8 * 8;
+        thread_local size_t cached_lane = 0;
+        thread_local uint32_t shift_one = 0;
+        thread_local uint32_t shift_two = 0;
+        if (cached_lane != lane) {
+            shift_one = shiftOperator(lane);
+            shift_two = shiftOperator(2 * lane);
+            cached_lane = lane;
+        }
+
+        uint64_t a = crc;
+        uint64_t b = 0;
+        uint64_t c = 0;
+        const uint8_t* second = data + lane;
+        const uint8_t* third = data + 2 * lane;
+        for (size_t i = 0; i < lane; i += 8) {
+            uint64_t wa, wb, wc;
+            std::memcpy(&wa, data + i, sizeof(wa));
+            std::memcpy(&wb, second + i, sizeof(wb));
+            std::memcpy(&wc, third + i, sizeof(wc));
+            a = _mm_crc32_u64(a, wa);
+            b = _mm_crc32_u64(b, wb);
+            c = _mm_crc32_u64(c, wc);
+        }
+        crc = multiplyModP(shift_two, static_cast<uint32_t>(a)) ^
+              multiplyModP(shift_one, static_cast<uint32_t>(b)) ^ static_cast<uint32_t>(c);
+        data += 3 * lane;
+        size -= 3 * lane;
+    }
+
+    uint64_t crc64 = crc;
+    while (size >= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+        size -= 8;
+    }
+    crc = static_cast<uint32_t>(crc64);
+#endif
+    while (size >= 4) {
+        uint32_t word;
+        std::memcpy(&word, data, sizeof(word));
+        crc = _mm_crc32_u32(crc, word);
+        data += 4;
+        size -= 4;
+    }
+    while (size-- > 0) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+#endif
+
+using Kernel = uint32_t (*)(uint32_t, const uint8_t*, size_t);
+
+// Elegir la implementación una sola vez según la CPU
+Kernel kernel() {
+    static const Kernel selected = [] {
+#ifdef CRC32C_X86
+        if (__builtin_cpu_supports("sse4.2")) {
+            return static_cast<Kernel>(crcHardware);
+        }
+#endif
+        return static_cast<Kernel>(crcSoftware);
+    }();
+    return selected;
+}
+}
+
+uint32_t Crc32c::compute(const void* data, size_t size, uint32_t crc) {
+    return ~kernel()(~crc, static_cast<const uint8_t*>(data), size);
+}
+
+bool Crc32c::hardwareAccelerated() {
+#ifdef CRC32C_X86
+    return kernel() != static_cast<Kernel>(crcSoftware);
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// CRC32C (polinomio de Castagnoli), el mismo que usan iSCSI, ext4 o btrfs.
+// Usa la instrucción crc32 de SSE4.2 si la CPU la tiene (se detecta al primer uso)
+// y, si no, una versión por tablas que procesa 8 bytes por iteración (slicing-by-8).
+class Crc32c
+{
+public:
+    // Calcular el CRC de 'size' bytes, continuando desde 'crc' (0 para empezar)
+    static uint32_t compute(const void *data, size_t size, uint32_t crc = 0);
+
+    // Indica si se está usando la instrucción de la CPU
+    static bool hardwareAccelerated();
+};
@@ -0,0 +1,199 @@
+#include "DedupIndex.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <unistd.h>
+
+namespace {
+// Identificador del archivo del índice ("DEDUPIDX")
+constexpr uint64_t INDEX_MAGIC = 0x5844495055444544ULL;
+
+// Registro del diario: bloque (con el bit alto si se borró), huella alta, huella baja
+constexpr uint64_t ERASED_FLAG = 1ULL << 63;
+
+inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t fmix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+}
+
+BlockFingerprint DedupIndex::fingerprint(const void* data, size_t size) {
+    // MurmurHash3_x64_128 (semilla 0)
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    const size_t nblocks = size / 16;
+    const uint64_t c1 = 0x87c37b91114253d5ULL;
+    const uint64_t c2 = 0x4cf5ad432745937fULL;
+    uint64_t h1 = 0;
+    uint64_t h2 = 0;
+
+    for (size_t i = 0; i < nblocks; i++) {
+        uint64_t k1, k2;
+        std::memcpy(&k1, bytes + i * 16, sizeof(k1));
+        std::memcpy(&k2, bytes + i * 16 + 8, sizeof(k2));
+
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    // Cola de menos de 16 bytes
+    const uint8_t* tail = bytes + nblocks * 16;
+    uint64_t k1 = 0;
+    uint64_t k2 = 0;
+    switch (size & 15) {
+    case 15: k2 ^= static_cast<uint64_t>(tail[14]) << 48; [[fallthrough]];
+    case 14: k2 ^= static_cast<uint64_t>(tail[13]) << 40; [[fallthrough]];
+    case 13: k2 ^= static_cast<uint64_t>(tail[12]) << 32; [[fallthrough]];
+    case 12: k2 ^= static_cast<uint64_t>(tail[11]) << 24; [[fallthrough]];
+    case 11: k2 ^= static_cast<uint64_t>(tail[10]) << 16; [[fallthrough]];
+    case 10: k2 ^= static_cast<uint64_t>(tail[9]) << 8; [[fallthrough]];
+    case 9:
+        k2 ^= static_cast<uint64_t>(tail[8]);
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+        [[fallthrough]];
+    case 8: k1 ^= static_cast<uint64_t>(tail[7]) << 56; [[fallthrough]];
+    case 7: k1 ^= static_cast<uint64_t>(tail[6]) << 48; [[fallthrough]];
+    case 6: k1 ^= static_cast<uint64_t>(tail[5]) << 40; [[fallthrough]];
+    case 5: k1 ^= static_cast<uint64_t>(tail[4]) << 32; [[fallthrough]];
+    case 4: k1 ^= static_cast<uint64_t>(tail[3]) << 24; [[fallthrough]];
+    case 3: k1 ^= static_cast<uint64_t>(tail[2]) << 16; [[fallthrough]];
+    case 2: k1 ^= static_cast<uint64_t>(tail[1]) << 8; [[fallthrough]];
+    case 1:
+        k1 ^= static_cast<uint64_t>(tail[0]);
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+        break;
+    default:
+        break;
+    }
+
+    h1 ^= size;
+    h2 ^= size;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+    return BlockFingerprint{h2, h1};
+}
+
+size_t DedupIndex::find(const BlockFingerprint& fingerprint) const {
+    auto it = by_fingerprint.find(fingerprint);
+    return it == by_fingerprint.end() ? npos : it->second;
+}
+
+void DedupIndex::insert(const BlockFingerprint& fingerprint, size_t block_index) {
+    bool replaced = eraseEntry(block_index);
+    if (by_fingerprint.emplace(fingerprint, block_index).second) {
+        by_block[block_index] = fingerprint;
+        changes.push_back({block_index, fingerprint, false});
+    } else if (replaced) {
+        changes.push_back({block_index, {0, 0}, true});
+    }
+}
+
+bool DedupIndex::erase(size_t block_index) {
+    if (!eraseEntry(block_index)) {
+        return false;
+    }
+    changes.push_back({block_index, {0, 0}, true});
+    return true;
+}
+
+bool DedupIndex::eraseEntry(size_t block_index) {
+    auto it = by_block.find(block_index);
+    if (it == by_block.end()) {
+        return false;
+    }
+    auto owner = by_fingerprint.find(it->second);
+    if (owner != by_fingerprint.end() && owner->second == block_index) {
+        by_fingerprint.erase(owner);
+    }
+    by_block.erase(it);
+    return true;
+}
+
+DedupIndex::Changes DedupIndex::takeChanges() {
+    Changes taken;
+    taken.swap(changes);
+    return taken;
+}
+
+DedupIndex::Entries DedupIndex::entries() const {
+    return Entries(by_block.begin(), by_block.end());
+}
+
+bool DedupIndex::writeSnapshot(const std::string& path, const Entries& entries) {
+    // Escribir en un archivo temporal y renombrar para no dejar un índice a medias
+    std::string temp_path = path + ".tmp";
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        return false;
+    }
+    uint64_t header[2] = {INDEX_MAGIC, static_cast<uint64_t>(entries.size())};
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    for (const auto& [block_index, fingerprint] : entries) {
+        uint64_t entry[3] = {static_cast<uint64_t>(block_index), fingerprint.high, fingerprint.low};
+        file.write(reinterpret_cast<const char*>(entry), sizeof(entry));
+    }
+    file.close();
+    if (!file) {
+        return false;
+    }
+    return std::rename(temp_path.c_str(), path.c_str()) == 0;
+}
+
+bool DedupIndex::appendChanges(int descriptor, const Changes& changes) {
+    // Un solo write con todos los registros: con O_APPEND van juntos al final del archivo
+    std::vector<uint64_t> records;
+    records.reserve(changes.size() * 3);
+    for (const Change& change : changes) {
+        records.push_back(static_cast<uint64_t>(change.block_index) | (change.erased ? ERASED_FLAG : 0));
+        records.push_back(change.fingerprint.high);
+        records.push_back(change.fingerprint.low);
+    }
+    size_t bytes = records.size() * sizeof(uint64_t);
+    return write(descriptor, records.data(), bytes) == static_cast<ssize_t>(bytes);
+}
+
+bool DedupIndex::load(const std::string& path, size_t& journal_records) {
+    by_fingerprint.clear();
+    by_block.clear();
+    journal_records = 0;
+
+    std::ifstream file(path, std::ios::binary);
+    uint64_t header[2];
+    if (!file || !file.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != INDEX_MAGIC) {
+        return false;
+    }
+    uint64_t entry[3];
+    for (uint64_t i = 0; i < header[1]; i++) {
+        if (!file.read(reinterpret_cast<char*>(entry), sizeof(entry))) {
+            changes.clear();
+            return false;
+        }
+        insert(BlockFingerprint{entry[1], entry[2]}, static_cast<size_t>(entry[0]));
+    }
+
+    // Diario: aplicar los registros completos en orden
+    while (file.read(reinterpret_cast<char*>(entry), sizeof(entry))) {
+        size_t block_index = static_cast<size_t>(entry[0] & ~ERASED_FLAG);
+        if (entry[0] & ERASED_FLAG) {
+            eraseEntry(block_index);
+        } else {
+            insert(BlockFingerprint{entry[1], entry[2]}, block_index);
+        }
+        journal_records++;
+    }
+    changes.clear();
+    return file.gcount() == 0;
+}
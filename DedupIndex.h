@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Huella de 128 bits del contenido de un bloque
+struct BlockFingerprint
+{
+    uint64_t high;
+    uint64_t low;
+
+    bool operator==(const BlockFingerprint &other) const { return high == other.high && low == other.low; }
+};
+
+struct BlockFingerprintHash
+{
+    size_t operator()(const BlockFingerprint &fingerprint) const { return static_cast<size_t>(fingerprint.low); }
+};
+
+// Índice de deduplicación: huella de contenido -> bloque físico que lo guarda.
+// La huella solo selecciona un candidato; quien lo use debe comparar los bytes,
+// así que una colisión o una entrada obsoleta nunca provoca compartir datos distintos.
+// No tiene mutex propio: lo protege el dueño (BlockManager::state_mutex).
+class DedupIndex
+{
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    // Calcular la huella (MurmurHash3 x64 de 128 bits) de un bloque
+    static BlockFingerprint fingerprint(const void *data, size_t size);
+
+    // Bloque registrado con esta huella (npos si no hay ninguno)
+    size_t find(const BlockFingerprint &fingerprint) const;
+
+    // Registrar el contenido de un bloque; si la huella ya tenía un bloque, se conserva el anterior
+    void insert(const BlockFingerprint &fingerprint, size_t block_index);
+
+    // Olvidar un bloque (al liberarse); devuelve true si estaba registrado
+    bool erase(size_t block_index);
+
+    size_t size() const { return by_block.size(); }
+
+    // Persistencia en un archivo binario: una instantánea (pares bloque-huella) seguida de un
+    // diario de cambios de tamaño fijo. Cada insert/erase efectivo se apunta en memoria;
+    // takeChanges los entrega (coste proporcional a los cambios) para añadirlos al diario, y
+    // cuando el diario crece se reescribe la instantánea con entries(). El índice es solo una
+    // pista (los bytes se comparan siempre), así que un diario incompleto tras una caída solo
+    // pierde oportunidades de deduplicar.
+    struct Change
+    {
+        size_t block_index;
+        BlockFingerprint fingerprint;
+        bool erased;
+    };
+    using Changes = std::vector<Change>;
+    using Entries = std::vector<std::pair<size_t, BlockFingerprint>>;
+
+    Changes takeChanges();
+    Entries entries() const;
+
+    // Las funciones de archivo no tocan el índice: se pueden llamar sin el mutex del dueño.
+    // writeSnapshot escribe en un temporal y lo renombra; appendChanges añade al diario abierto
+    // en 'descriptor' (con O_APPEND).
+    static bool writeSnapshot(const std::string &path, const Entries &entries);
+    static bool appendChanges(int descriptor, const Changes &changes);
+
+    // Cargar la instantánea y aplicar el diario; deja en 'journal_records' los cambios leídos del
+    // diario. Devuelve false si el archivo no existe, no es válido o termina en un registro a
+    // medias (una caída durante una escritura): en ese caso no se le puede seguir añadiendo y
+    // hay que reescribir la instantánea.
+    bool load(const std::string &path, size_t &journal_records);
+
+private:
+    std::unordered_map<BlockFingerprint, size_t, BlockFingerprintHash> by_fingerprint;
+    std::unordered_map<size_t, BlockFingerprint> by_block;
+    Changes changes;                 // Cambios aún no entregados con takeChanges
+
+    // Quitar la entrada de un bloque sin apuntar el cambio
+    bool eraseEntry(size_t block_index);
+};
@@ -2,35 +2,109 @@
 #include <iostream>
 #include <filesystem>
 #include <algorithm>
+#include <cstring>
+#include <chrono>
+#include <unordered_set>
 #include <iomanip> // Para std::setw, std::setfill, etc.
+#include "Crc32c.h"
 
 namespace fs = std::filesystem;
 
-FileSystem::FileSystem(const std::string &path, size_t storage_size_mb)
+namespace
+{
+// Bloques lógicos que el desfragmentador copia y publica de una vez
+constexpr size_t DEFRAG_BATCH = 256;
+
+// Rachas de bloques físicamente consecutivos en orden lógico; 'blocks' recibe los bloques sin huecos
+size_t countExtents(const std::vector<size_t> &block_list, size_t &blocks)
+{
+    size_t extents = 0;
+    size_t previous = HOLE_BLOCK;
+    blocks = 0;
+    for (size_t block : block_list)
+    {
+        if (block == HOLE_BLOCK)
+        {
+            continue;
+        }
+        if (previous == HOLE_BLOCK || block != previous + 1)
+        {
+            extents++;
+        }
+        previous = block;
+        blocks++;
+    }
+    return extents;
+}
+}
+
+FileSystem::FileSystem(const std::string &path, size_t storage_size_mb, const StorageOptions &options)
     : storage_path(path),
       metadata_dir(path + "_metadata"),
-      block_size(BLOCK_SIZE),
-      block_manager(path.c_str(), storage_size_mb * 1024 * 1024),
-      version_graph(block_manager)
+      block_size(0),
+      block_manager(path.c_str(), storage_size_mb * 1024 * 1024, options),
+      version_graph(block_manager),
+      defrag_status{false, 0, 0, 0},
+      defrag_stop(false),
+      next_view_id(1),
+      next_session_id(1),
+      checkpoint_requested(false),
+      mutation_seq(0),
+      durable_seq(0),
+      flushing(false),
+      flusher_stop(false)
 {
+    // El tamaño de bloque lo decide el almacén (el pedido si es nuevo, el de su cabecera si ya existe)
+    block_size = block_manager.getBlockSize();
+    zero_block.assign(block_size, '\0');
+
     // Crear directorio de metadatos si no existe
     if (!fs::exists(metadata_dir))
     {
         fs::create_directories(metadata_dir);
     }
 
-    // Cargar metadatos existentes
-    version_graph.loadMetadata(metadata_dir);
+    // Cargar metadatos existentes y reproducir los cambios del registro. Lo recuperado del
+    // registro aún no está en los .meta: se reescriben todos en el próximo punto de control
+    if (!metadata_log.open(metadata_dir + "/metadata.wal"))
+    {
+        std::cerr << "Aviso: sin registro de metadatos, cada vaciado reescribe los .meta\n";
+    }
+    bool loaded = version_graph.loadMetadata(metadata_dir, &metadata_log);
+    if (metadata_log.size() > 0)
+    {
+        for (const std::string &file_name : version_graph.getFileNames())
+        {
+            dirty_files.insert(file_name);
+        }
+    }
+
+    // Las referencias se sueltan después de guardar el cambio que las quita, así que una caída
+    // entre medias deja bloques marcados como usados que ya no referencia ninguna versión.
+    // Solo si los metadatos se cargaron bien: si no, todos los bloques parecerían huérfanos
+    size_t orphaned = loaded ? block_manager.freeUnreferenced() : 0;
+    if (orphaned > 0)
+    {
+        std::cout << "Recuperados " << orphaned << " bloques sin referencias\n";
+    }
 }
 
 FileSystem::~FileSystem()
 {
-    // Asegurar que todos los cambios se guarden
+    // Parar el desfragmentador y el hilo de vaciado, soltar las vistas que queden y asegurar
+    // que todos los cambios se guarden
+    stopDefrag();
+    setDurability(DurabilityOptions());
+    while (!open_views.empty())
+    {
+        releaseView(open_views.begin()->first);
+    }
     sync();
 }
 
 // Función para estadisticas de memoria 
 FileSystem::GlobalMemoryUsage FileSystem::getMemoryUsage() const {
+    std::lock_guard<std::recursive_mutex> lock(fs_mutex);
     GlobalMemoryUsage usage;
     usage.blocks = block_manager.getMemoryUsage();
     usage.versions = version_graph.getVersionMemoryUsage();
@@ -41,10 +115,55 @@ void FileSystem::printMemoryUsage() const {
     auto usage = getMemoryUsage();
     
     std::cout << "\n=== Uso de Memoria del Sistema ===\n";
-    std::cout << "Bloques físicos:\n"
+    std::cout << "Bloques físicos (de " << (block_size / 1024) << " KB):\n"
               << "  Usados: " << usage.blocks.used_blocks << "/" << usage.blocks.total_blocks 
               << " bloques (" << (usage.blocks.used_bytes / 1024) << " KB)\n"
               << "  Libres: " << usage.blocks.free_blocks << " bloques\n";
+    if (usage.blocks.max_blocks > usage.blocks.total_blocks)
+    {
+        std::cout << "  Crecimiento hasta: " << usage.blocks.max_blocks << " bloques ("
+                  << (usage.blocks.max_blocks * block_size / (1024 * 1024)) << " MB)\n";
+    }
+    if (usage.blocks.dedup_entries > 0)
+    {
+        std::cout << "  Deduplicación: " << usage.blocks.dedup_entries << " bloques indexados, "
+                  << usage.blocks.dedup_hits << " bloques reutilizados\n";
+    }
+    if (usage.blocks.packed_blocks > 0)
+    {
+        double ratio = usage.blocks.pack_slots > 0
+                           ? static_cast<double>(usage.blocks.packed_blocks) / usage.blocks.pack_slots
+                           : 0.0;
+        std::ios::fmtflags flags = std::cout.flags();
+        std::streamsize precision = std::cout.precision();
+        std::cout << "  Compresión: " << usage.blocks.packed_blocks << " bloques en "
+                  << usage.blocks.pack_slots << " bloques físicos (" << (usage.blocks.packed_bytes / 1024)
+                  << " KB comprimidos, ratio " << std::fixed << std::setprecision(2) << ratio << ":1)\n";
+        std::cout.flags(flags);
+        std::cout.precision(precision);
+    }
+    std::cout << "  Ocupado en disco: " << (usage.blocks.disk_bytes / 1024) << " KB\n";
+    std::cout << "  Grupos de asignación: " << usage.blocks.allocation_groups << " de "
+              << usage.blocks.group_blocks << " bloques\n";
+    if (usage.blocks.checksums)
+    {
+        std::cout << "  Sumas CRC32C: " << (Crc32c::hardwareAccelerated() ? "SSE4.2" : "por tablas")
+                  << ", " << usage.blocks.checksum_failures << " lecturas con error\n";
+    }
+
+    if (usage.blocks.cache.capacity_blocks > 0)
+    {
+        std::cout << "\nCaché de bloques:\n"
+                  << "  Residentes: " << usage.blocks.cache.resident_blocks << "/"
+                  << usage.blocks.cache.capacity_blocks << " bloques\n"
+                  << "  Aciertos: " << usage.blocks.cache.hits
+                  << "  Fallos: " << usage.blocks.cache.misses
+                  << "  Expulsiones: " << usage.blocks.cache.evictions << "\n";
+    }
+    if (usage.blocks.io_buffer_bytes > 0)
+    {
+        std::cout << "  E/S directa (O_DIRECT): pool de " << (usage.blocks.io_buffer_bytes / 1024) << " KB\n";
+    }
     
     std::cout << "\nVersiones lógicas:\n"
               << "  Archivos: " << usage.versions.total_files << "\n"
@@ -56,6 +175,7 @@ void FileSystem::printMemoryUsage() const {
 
 bool FileSystem::create(const std::string &file_name, const std::string &file_type)
 {
+    std::unique_lock<std::recursive_mutex> lock(fs_mutex);
     if (version_graph.fileExists(file_name))
     {
         std::cerr << "Error: El archivo '" << file_name << "' ya existe.\n";
@@ -74,6 +194,9 @@ bool FileSystem::create(const std::string &file_name, const std::string &file_ty
     {
         // Los metadatos ya se habrán creado en addVersion
         std::cout << "Archivo '" << file_name << "' creado correctamente.\n";
+        size_t sequence = noteMutation(file_name);
+        lock.unlock();
+        finishMutation(sequence);
         return true;
     }
 
@@ -83,6 +206,7 @@ bool FileSystem::create(const std::string &file_name, const std::string &file_ty
 
 bool FileSystem::open(const std::string &filename)
 {
+    std::lock_guard<std::recursive_mutex> lock(fs_mutex);
     // 1. Validar que existe y no está ya abierto
     if (!version_graph.fileExists(filename) || isOpen(filename))
     {
@@ -100,15 +224,26 @@ bool FileSystem::open(const std::string &filename)
 
 bool FileSystem::close(const std::string &filename)
 {
-    // 1. Validar que está abierto
-    if (!isOpen(filename))
-        return false;
+    {
+        std::lock_guard<std::recursive_mutex> lock(fs_mutex);
+        // 1. Validar que está abierto
+        if (!isOpen(filename))
+            return false;
 
-    // 2. Sincronizar cambios (opcional)
-    sync();
+        // 2. Descartar las sesiones de escritura sin confirmar y eliminar de archivos abiertos
+        for (auto it = sessions.begin(); it != sessions.end();)
+        {
+            it = (it->second.file_name == filename) ? sessions.erase(it) : std::next(it);
+        }
+        open_files.erase(filename);
+    }
 
-    // 3. Eliminar de archivos abiertos
-    open_files.erase(filename);
+    // 3. Hacer durables los cambios pendientes (solo se guardan los archivos modificados). Con
+    //    escritura agrupada no se espera: el hilo de vaciado los guardará en su próximo intervalo
+    if (getDurability().mode != DurabilityMode::GroupCommit)
+    {
+        barrier();
+    }
     return true;
 }
 
@@ -118,6 +253,174 @@ bool FileSystem::isOpen(const std::string &filename) const
 }
 
 bool FileSystem::write(const std::string &file_name, size_t offset, const std::vector<char> &data)
+{
+    std::unique_lock<std::recursive_mutex> lock(fs_mutex);
+    if (!checkWritable(file_name))
+    {
+        return false;
+    }
+
+    // implementacion de copy on write: una escritura suelta es una sesión de una sola llamada.
+    // Solo se leen y se escriben los bloques lógicos que solapan [offset, offset + data.size());
+    // el resto de la lista se copia de la versión padre
+    WriteSession session;
+    if (!startSession(file_name, session) || !stageWrite(session, offset, data))
+    {
+        return false;
+    }
+    size_t new_version = 0;
+    if (!publishSession(session, new_version))
+    {
+        return false;
+    }
+    std::cout << "Archivo '" << file_name << "' modificado correctamente (versión " << new_version << ").\n";
+    size_t sequence = noteMutation(file_name);
+    lock.unlock();
+    finishMutation(sequence);
+    return true;
+}
+
+size_t FileSystem::beginSession(const std::string &file_name)
+{
+    std::lock_guard<std::recursive_mutex> lock(fs_mutex);
+    if (!checkWritable(file_name))
+    {
+        return 0;
+    }
+    WriteSession session;
+    if (!startSession(file_name, session))
+    {
+        return 0;
+    }
+    size_t session_id = next_session_id++;
+    sessions.emplace(session_id, std::move(session));
+    return session_id;
+}
+
+bool FileSystem::sessionWrite(size_t session_id, size_t offset, const std::vector<char> &data)
+{
+    std::lock_guard<std::recursive_mutex> lock(fs_mutex);
+    auto it = sessions.find(session_id);
+    if (it == sessions.end())
+    {
+        std::cerr << "Error: La sesión de escritura " << session_id << " no existe.\n";
+        return false;
+    }
+    return stageWrite(it->second, offset, data);
+}
+
+bool FileSystem::commitSession(size_t session_id)
+{
+    std::unique_lock<std::recursive_mutex> lock(fs_mutex);
+    auto it = sessions.find(session_id);
+    if (it == sessions.end())
+    {
+        std::cerr << "Error: La sesión de escritura " << session_id << " no existe.\n";
+        return false;
+    }
+
+    // La sesión termina tanto si se publica como si no: un fallo equivale a abortarla
+    WriteSession session = std::move(it->second);
+    sessions.erase(it);
+    if (!checkWritable(session.file_name))
+    {
+        return false;
+    }
+    if (session.slots.empty() && session.block_count <= session.base_blocks)
+    {
+        return true; // Nada que publicar
+    }
+    size_t new_version = 0;
+    if (!publishSession(session, new_version))
+    {
+        return false;
+    }
+    std::cout << "Archivo '" << session.file_name << "' modificado correctamente (versión " << new_version
+              << ", " << session.writes << " escrituras).\n";
+    size_t sequence = noteMutation(session.file_name);
+    lock.unlock();
+    finishMutation(sequence);
+    return true;
+}
+
+bool FileSystem::commitSessions(const std::vector<size_t> &session_ids)
+{
+    std::unique_lock<std::recursive_mutex> lock(fs_mutex);
+
+    // 1. Sacar todas las sesiones: terminan tanto si el lote se confirma como si no
+    std::vector<WriteSession> batch;
+    bool valid = true;
+    for (size_t session_id : session_ids)
+    {
+        auto it = sessions.find(session_id);
+        if (it == sessions.end())
+        {
+            std::cerr << "Error: La sesión de escritura " << session_id << " no existe.\n";
+            valid = false;
+            continue;
+        }
+        batch.push_back(std::move(it->second));
+        sessions.erase(it);
+    }
+    std::unordered_set<std::string> files;
+    for (const WriteSession &session : batch)
+    {
+        if (!files.insert(session.file_name).second)
+        {
+            std::cerr << "Error: El lote tiene dos sesiones del archivo '" << session.file_name << "'.\n";
+            valid = false;
+        }
+        valid = checkWritable(session.file_name) && valid;
+    }
+    if (!valid)
+    {
+        return false;
+    }
+
+    // 2. Escribir los bloques de todas las versiones; si alguna falla, soltar lo reservado por
+    //    las anteriores sin haber publicado ninguna
+    std::vector<PreparedVersion> prepared(batch.size());
+    for (size_t i = 0; i < batch.size(); i++)
+    {
+        if (!prepareSession(batch[i], prepared[i]))
+        {
+            for (size_t j = 0; j < i; j++)
+            {
+                discardPrepared(prepared[j]);
+            }
+            return false;
+        }
+    }
+
+    // 3. Publicarlas juntas en memoria (nadie las ve a medias: todo ocurre con fs_mutex tomado)
+    //    y dejar todos sus archivos pendientes a la vez, así que irán en el mismo vaciado
+    size_t sequence = 0;
+    for (const PreparedVersion &version : prepared)
+    {
+        applyPrepared(version);
+        sequence = noteMutation(version.file_name);
+    }
+    lock.unlock();
+
+    // 4. Hacerlas durables en cualquier modo: primero los bloques y el mapa, después los
+    //    registros de todas en un mismo grupo del registro de metadatos, cuyo registro de
+    //    confirmación es el punto de confirmación (ver flushPending)
+    if (!waitDurable(sequence))
+    {
+        std::cerr << "Error: No se pudieron guardar los metadatos del lote.\n";
+        return false;
+    }
+    std::cout << "Lote confirmado: " << prepared.size() << " archivos.\n";
+    return true;
+}
+
+void FileSystem::abortSession(size_t session_id)
+{
+    std::lock_guard<std::recursive_mutex> lock(fs_mutex);
+    sessions.erase(session_id);
+}
+
+bool FileSystem::checkWritable(const std::string &file_name) const
 {
     if (!version_graph.fileExists(file_name))
     {
@@ -129,102 +432,273 @@ bool FileSystem::write(const std::string &file_name, size_t offset, const std::v
         std::cerr << "Error: El archivo '" << file_name << "' no está abierto.\n";
         return false;
     }
+    return true;
+}
 
-    // Leer contenido actual
-    std::vector<char> current_data = read(file_name);
-
-    // Crear copia del contenido actual para modificar
-    std::vector<char> new_data;
+bool FileSystem::startSession(const std::string &file_name, WriteSession &session) const
+{
+    session.file_name = file_name;
+    session.base_version = version_graph.getCurrentVersion(file_name);
+    const VersionInfo *base_info = version_graph.getVersion(file_name, session.base_version);
+    if (!base_info)
+    {
+        std::cerr << "Error: No se pudo obtener información de la versión actual.\n";
+        return false;
+    }
+    session.base_blocks = base_info->block_list.size();
+    session.block_count = session.base_blocks;
+    return true;
+}
 
-    if (offset <= current_data.size())
+bool FileSystem::stageWrite(WriteSession &session, size_t offset, const std::vector<char> &data)
+{
+    // 1. Bloques lógicos tocados [first_touched, end_touched). Escribir más allá del final
+    //    alarga el archivo con huecos, que se leen como ceros
+    size_t first_touched = offset / block_size;
+    size_t end_touched = data.empty() ? first_touched : (offset + data.size() + block_size - 1) / block_size;
+
+    // 2. Los bloques que la sesión aún no tiene se leen de la versión base, todos de una vez
+    //    (los que no existían empiezan a cero). Se guarda también su contenido original para
+    //    saber al publicar cuáles cambian de verdad
+    const VersionInfo *base_info = version_graph.getVersion(session.file_name, session.base_version);
+    if (!base_info)
+    {
+        std::cerr << "Error: La versión base de la escritura ya no existe.\n";
+        return false;
+    }
+    const std::vector<size_t> &base_blocks = base_info->block_list;
+    std::vector<size_t> missing_logical;
+    std::vector<size_t> missing_physical;
+    for (size_t logical = first_touched; logical < end_touched; logical++)
     {
-        // Caso normal: offset dentro del tamaño actual
-        new_data.assign(current_data.begin(), current_data.begin() + offset);
-        new_data.insert(new_data.end(), data.begin(), data.end());
-        if (offset + data.size() < current_data.size())
+        if (session.slots.count(logical) == 0)
         {
-            new_data.insert(new_data.end(),
-                            current_data.begin() + offset + data.size(),
-                            current_data.end());
+            missing_logical.push_back(logical);
+            missing_physical.push_back(logical < base_blocks.size() ? base_blocks[logical] : HOLE_BLOCK);
         }
     }
-    else
+    if (!missing_logical.empty())
     {
-        // Caso especial: offset más allá del tamaño actual
-        new_data = current_data;
-        // Rellenar con espacios (podría ser '\0' u otro carácter)
-        new_data.resize(offset, ' '); // Cambiado de '\0' a ' ' para mejor visualización
-        new_data.insert(new_data.end(), data.begin(), data.end());
+        size_t first_slot = session.original.size() / block_size;
+        session.original.resize(session.original.size() + missing_logical.size() * block_size);
+        if (!block_manager.readBlocksAsync(missing_physical, session.original.data() + first_slot * block_size).get())
+        {
+            session.original.resize(first_slot * block_size);
+            std::cerr << "Error: No se pudieron leer los bloques que modifica la escritura.\n";
+            return false;
+        }
+        session.content.insert(session.content.end(), session.original.begin() + first_slot * block_size,
+                               session.original.end());
+        for (size_t j = 0; j < missing_logical.size(); j++)
+        {
+            session.slots.emplace(missing_logical[j], first_slot + j);
+        }
     }
-    // implementacion de copy on write
-
-    // 1. Calcular qué bloques se modificaron
-    std::vector<size_t> modified_blocks = calculateModifiedBlocks(current_data, new_data);
 
-    // 2. Dividir datos nuevos en bloques
-    std::vector<std::pair<size_t, std::vector<char>>> new_blocks = splitIntoBlocks(new_data);
-
-    // 3. Obtener bloques de la versión actual
-    size_t current_version = version_graph.getCurrentVersion(file_name);
-    const VersionInfo *current_version_info = version_graph.getVersion(file_name, current_version);
+    // 3. Mezclar los bytes nuevos bloque a bloque
+    size_t copied = 0;
+    for (size_t logical = first_touched; logical < end_touched; logical++)
+    {
+        size_t begin = (logical == first_touched) ? offset - first_touched * block_size : 0;
+        size_t count = std::min(block_size - begin, data.size() - copied);
+        std::memcpy(session.content.data() + session.slots[logical] * block_size + begin, data.data() + copied, count);
+        copied += count;
+    }
+    session.block_count = std::max(session.block_count, end_touched);
+    session.writes++;
+    return true;
+}
 
+bool FileSystem::prepareSession(const WriteSession &session, PreparedVersion &prepared)
+{
+    // 1. La sesión se preparó sobre la versión base: si entretanto otra escritura o un rollback
+    //    cambió la versión actual, sus bloques ya no se pueden aplicar encima
+    size_t current_version = version_graph.getCurrentVersion(session.file_name);
+    if (current_version != session.base_version)
+    {
+        std::cerr << "Error: El archivo '" << session.file_name << "' cambió (versión " << current_version
+                  << ") desde que empezó la escritura sobre la versión " << session.base_version << ".\n";
+        return false;
+    }
+    const VersionInfo *current_version_info = version_graph.getVersion(session.file_name, current_version);
     if (!current_version_info)
     {
         std::cerr << "Error: No se pudo obtener información de la versión actual.\n";
         return false;
     }
+    const std::vector<size_t> &parent_blocks = current_version_info->block_list;
+    auto blockData = [&](size_t logical) { return session.content.data() + session.slots.at(logical) * block_size; };
+
+    // 2. Determinar qué bloques lógicos cambian: los que no existían en la versión padre y los
+    //    tocados cuyo contenido difiere. Los que solo contienen ceros no se guardan: quedan como huecos
+    std::vector<size_t> &new_version_blocks = prepared.block_list;
+    new_version_blocks.assign(parent_blocks.begin(), parent_blocks.end());
+    new_version_blocks.resize(session.block_count, HOLE_BLOCK);
+    std::vector<size_t> &modified_blocks = prepared.modified_blocks;
+    modified_blocks.clear();
+    std::vector<size_t> blocks_to_allocate;
+    for (size_t logical = parent_blocks.size(); logical < session.block_count; logical++)
+    {
+        if (session.slots.count(logical) == 0)
+        {
+            modified_blocks.push_back(logical); // Hueco nuevo entre el final anterior y lo escrito
+        }
+    }
+    for (const auto &slot : session.slots)
+    {
+        size_t logical = slot.first;
+        const char *block_data = session.content.data() + slot.second * block_size;
+        bool existed = logical < parent_blocks.size();
+        if (existed && std::memcmp(block_data, session.original.data() + slot.second * block_size, block_size) == 0)
+        {
+            continue;
+        }
+        modified_blocks.push_back(logical);
+        if (BlockManager::isZeroBlock(block_data, block_size))
+        {
+            new_version_blocks[logical] = HOLE_BLOCK;
+        }
+        else
+        {
+            blocks_to_allocate.push_back(logical);
+        }
+    }
+    std::sort(modified_blocks.begin(), modified_blocks.end());
 
-    // 4. Crear lista de bloques para la nueva versión
-    std::vector<size_t> new_version_blocks;
-
-    // Para cada bloque lógico de datos
-    for (size_t i = 0; i < new_blocks.size(); i++)
+    // 3. Con deduplicación, reutilizar los bloques físicos que ya guardan exactamente ese
+    //    contenido (en cualquier archivo o versión) o que se repiten dentro de esta escritura
+    std::vector<std::pair<size_t, size_t>> repeated_from; // lógico -> lógico anterior igual
+    std::vector<BlockFingerprint> &fingerprints = prepared.fingerprints;
+    if (block_manager.dedupEnabled())
     {
-        // Verificar si este bloque lógico se modificó
-        if (std::find(modified_blocks.begin(), modified_blocks.end(), i) != modified_blocks.end())
+        std::vector<size_t> unique_blocks;
+        std::unordered_map<BlockFingerprint, size_t, BlockFingerprintHash> first_seen;
+        for (size_t logical : blocks_to_allocate)
         {
-            // Bloque modificado: asignar un nuevo bloque físico
-            size_t new_block_index = block_manager.allocateBlock();
-            if (new_block_index == static_cast<size_t>(-1))
+            const char *block_data = blockData(logical);
+            BlockFingerprint fingerprint = DedupIndex::fingerprint(block_data, block_size);
+            size_t existing = block_manager.findDuplicate(block_data, fingerprint);
+            if (existing != DedupIndex::npos)
+            {
+                new_version_blocks[logical] = existing;
+                continue;
+            }
+            auto seen = first_seen.find(fingerprint);
+            if (seen != first_seen.end() && std::memcmp(blockData(seen->second), block_data, block_size) == 0)
             {
-                std::cerr << "Error: No hay espacio disponible para asignar nuevos bloques.\n";
-                return false;
+                repeated_from.emplace_back(logical, seen->second);
+                continue;
             }
+            first_seen.emplace(fingerprint, logical);
+            unique_blocks.push_back(logical);
+            fingerprints.push_back(fingerprint);
+        }
+        blocks_to_allocate.swap(unique_blocks);
+    }
+
+    // 4. Reservar todos los bloques nuevos de una vez en rachas contiguas,
+    //    preferentemente justo después del bloque físico anterior del archivo (saltando huecos)
+    size_t hint = 0;
+    if (!blocks_to_allocate.empty())
+    {
+        size_t first = blocks_to_allocate.front();
+        size_t previous = std::min(first, parent_blocks.size());
+        while (previous > 0 && parent_blocks[previous - 1] == HOLE_BLOCK)
+        {
+            previous--;
+        }
+        if (previous > 0)
+        {
+            hint = parent_blocks[previous - 1] + 1;
+        }
+    }
 
-            // Escribir datos en el nuevo bloque
-            block_manager.writeBlock(new_block_index, new_blocks[i].second.data(), new_blocks[i].second.size());
-            new_version_blocks.push_back(new_block_index);
+    std::vector<size_t> &allocated_blocks = prepared.allocated_blocks;
+    if (!blocks_to_allocate.empty())
+    {
+        std::vector<BlockManager::Extent> extents = block_manager.allocateExtent(blocks_to_allocate.size(), hint);
+        if (extents.empty())
+        {
+            std::cerr << "Error: No hay espacio disponible para asignar nuevos bloques.\n";
+            return false;
         }
-        else
+        for (const auto &extent : extents)
         {
-            // Bloque no modificado: reutilizar el bloque de la versión anterior
-            if (i < current_version_info->block_list.size())
-            {
-                new_version_blocks.push_back(current_version_info->block_list[i]);
-            }
-            else
+            for (size_t j = 0; j < extent.length; j++)
             {
-                // Este caso no debería ocurrir, pero lo manejamos por si acaso
-                std::cerr << "Advertencia: Inconsistencia en bloques no modificados.\n";
-                size_t new_block_index = block_manager.allocateBlock();
-                block_manager.writeBlock(new_block_index, new_blocks[i].second.data(), new_blocks[i].second.size());
-                new_version_blocks.push_back(new_block_index);
+                allocated_blocks.push_back(extent.start + j);
             }
         }
     }
 
-    // 5. Crear nueva versión
-    size_t new_version = current_version + 1;
-    version_graph.addVersion(file_name, new_version, new_version_blocks, modified_blocks, current_version);
+    // 5. Reunir los datos de los bloques nuevos en un buffer contiguo y enviarlos
+    //    todos a la vez al motor de E/S asíncrona
+    std::vector<char> write_buffer(allocated_blocks.size() * block_size);
+    for (size_t j = 0; j < blocks_to_allocate.size(); j++)
+    {
+        std::memcpy(write_buffer.data() + j * block_size, blockData(blocks_to_allocate[j]), block_size);
+    }
+    std::future<bool> pending_write = block_manager.writeBlocksAsync(allocated_blocks, write_buffer.data());
 
-    // Actualizar metadatos
-    // Ya tenemos la referencia a los metadatos, no necesitamos obtenerlos de nuevo
-    std::cout << "Archivo '" << file_name << "' modificado correctamente (versión " << new_version << ").\n";
+    // 6. Mientras se escriben los bloques, completar la lista de la nueva versión
+    for (size_t j = 0; j < blocks_to_allocate.size(); j++)
+    {
+        // Bloque modificado: va al nuevo bloque físico
+        new_version_blocks[blocks_to_allocate[j]] = allocated_blocks[j];
+    }
+    for (const auto &repeated : repeated_from)
+    {
+        // Repetido dentro de esta escritura: compartir el bloque de su primera aparición
+        new_version_blocks[repeated.first] = new_version_blocks[repeated.second];
+    }
+
+    // 7. La versión solo se puede publicar cuando todos sus bloques estén escritos
+    if (!pending_write.get())
+    {
+        std::cerr << "Error: No se pudieron escribir los bloques de la nueva versión.\n";
+        discardPrepared(prepared);
+        return false;
+    }
+    prepared.file_name = session.file_name;
+    prepared.parent_version = current_version;
+    prepared.version_id = current_version + 1;
+    return true;
+}
+
+void FileSystem::discardPrepared(PreparedVersion &prepared)
+{
+    for (size_t block_index : prepared.allocated_blocks)
+    {
+        block_manager.freeBlock(block_index);
+    }
+    prepared.allocated_blocks.clear();
+}
+
+void FileSystem::applyPrepared(const PreparedVersion &prepared)
+{
+    for (size_t j = 0; j < prepared.fingerprints.size(); j++)
+    {
+        block_manager.registerContent(prepared.allocated_blocks[j], prepared.fingerprints[j]);
+    }
+    version_graph.addVersion(prepared.file_name, prepared.version_id, prepared.block_list,
+                             prepared.modified_blocks, prepared.parent_version);
+}
+
+bool FileSystem::publishSession(const WriteSession &session, size_t &new_version)
+{
+    PreparedVersion prepared;
+    if (!prepareSession(session, prepared))
+    {
+        return false;
+    }
+    applyPrepared(prepared);
+    new_version = prepared.version_id;
     return true;
 }
 
 std::vector<char> FileSystem::read(const std::string &file_name)
 {
+    std::lock_guard<std::recursive_mutex> lock(fs_mutex);
     if (!isOpen(file_name))
     {
         std::cerr << "Error: El archivo '" << file_name << "' no está abierto.\n";
@@ -257,59 +731,228 @@ std::vector<char> FileSystem::read(const std::string &file_name)
     return file_data;
 }
 
-bool FileSystem::rollbackFile(const std::string &file_name, size_t version_id)
+size_t FileSystem::read(const std::string &file_name, size_t offset, size_t length, char *buffer, size_t version_id)
 {
-    if (!version_graph.fileExists(file_name))
+    std::lock_guard<std::recursive_mutex> lock(fs_mutex);
+    if (!isOpen(file_name))
     {
-        std::cerr << "Error: El archivo '" << file_name << "' no existe.\n";
-        return false;
+        std::cerr << "Error: El archivo '" << file_name << "' no está abierto.\n";
+        return 0;
     }
 
-    // Verificar si la versión existe
-    const VersionInfo *version_info = version_graph.getVersion(file_name, version_id);
-    if (!version_info)
+    if (!version_graph.fileExists(file_name))
     {
-        std::cerr << "Error: La versión " << version_id << " no existe para el archivo '" << file_name << "'.\n";
-        return false;
+        std::cerr << "Error: El archivo '" << file_name << "' no existe.\n";
+        return 0;
     }
 
-    // Restaurar la versión
-    std::vector<char> restored_data;
-    if (!version_graph.restoreVersion(file_name, version_id, restored_data))
+    if (version_id == 0)
     {
-        std::cerr << "Error durante el rollback.\n";
-        return false;
+        version_id = version_graph.getCurrentVersion(file_name);
     }
-    // No es necesario restaurar los datos, solo actualizar la versión actual
-    std::vector<char> dummy;
-    if (!version_graph.restoreVersion(file_name, version_id, dummy))
+    size_t bytes_read = 0;
+    if (!version_graph.readRange(file_name, version_id, offset, length, buffer, bytes_read))
     {
-        std::cerr << "Error durante el rollback.\n";
-        return false;
+        std::cerr << "Error: No se pudo leer el archivo '" << file_name << "'.\n";
+        return 0;
     }
-
-    std::cout << "Archivo '" << file_name << "' restaurado a la versión " << version_id << ".\n";
-    return true;
+    return bytes_read;
 }
 
-void FileSystem::printFileMetadata(const std::string &file_name)
+size_t FileSystem::getFileSize(const std::string &file_name, size_t version_id)
 {
-    const Metadata *metadata = version_graph.getFileMetadata(file_name);
-    if (!metadata)
+    std::lock_guard<std::recursive_mutex> lock(fs_mutex);
+    if (!version_graph.fileExists(file_name))
     {
         std::cerr << "Error: El archivo '" << file_name << "' no existe.\n";
-        return;
+        return 0;
     }
-
-    metadata->printMetadata();
+    return version_graph.getVersionSize(file_name, version_id != 0 ? version_id : version_graph.getCurrentVersion(file_name));
 }
 
-void FileSystem::listFiles()
+FileSystem::ReadView FileSystem::openView(const std::string &file_name, size_t offset, size_t length, size_t version_id)
 {
-    std::cout << "Archivos en el sistema:\n";
-
-    bool no_files = true;
-    for (const auto &entry : fs::directory_iterator(metadata_dir))
+    std::lock_guard<std::recursive_mutex> lock(fs_mutex);
+    ReadView view{0, {}, 0};
+    if (!isOpen(file_name))
+    {
+        std::cerr << "Error: El archivo '" << file_name << "' no está abierto.\n";
+        return view;
+    }
+    if (version_id == 0)
+    {
+        version_id = version_graph.getCurrentVersion(file_name);
+    }
+    const VersionInfo *version_info = version_graph.getVersion(file_name, version_id);
+    if (!version_info)
+    {
+        std::cerr << "Error: La versión " << version_id << " no existe para el archivo '" << file_name << "'.\n";
+        return view;
+    }
+
+    // Rango dentro del archivo y bloques lógicos [first, last) que lo cubren
+    size_t end = std::min(offset + length, version_graph.getVersionSize(file_name, version_id));
+    OpenView opened;
+    if (offset < end)
+    {
+        size_t first = offset / block_size;
+        size_t last = (end - 1) / block_size + 1;
+        std::vector<const char *> sources(last - first, nullptr);
+        std::vector<size_t> to_read;
+        for (size_t i = first; i < last; i++)
+        {
+            size_t block = version_info->block_list[i];
+            if (block == HOLE_BLOCK)
+            {
+                sources[i - first] = zero_block.data();
+                continue;
+            }
+            block_manager.addReference(block);
+            opened.pinned.push_back(block);
+            sources[i - first] = block_manager.blockData(block);
+            if (!sources[i - first])
+            {
+                to_read.push_back(block);
+            }
+        }
+
+        // Lo que no está en el mapeo se lee de una vez al buffer de la vista
+        opened.storage.resize(to_read.size() * block_size);
+        if (!to_read.empty() && !block_manager.readBlocksAsync(to_read, opened.storage.data()).get())
+        {
+            std::cerr << "Error: No se pudo leer el archivo '" << file_name << "'.\n";
+            for (size_t block : opened.pinned)
+            {
+                block_manager.releaseReference(block);
+            }
+            return view;
+        }
+        size_t next_read = 0;
+        for (size_t j = 0; j < sources.size(); j++)
+        {
+            if (!sources[j])
+            {
+                sources[j] = opened.storage.data() + next_read++ * block_size;
+            }
+
+            // Recortar el primer y el último bloque al rango y unir los segmentos contiguos en memoria
+            size_t block_start = (first + j) * block_size;
+            size_t from = std::max(offset, block_start) - block_start;
+            size_t to = std::min(end, block_start + block_size) - block_start;
+            char *base = const_cast<char *>(sources[j]) + from;
+            if (!view.segments.empty() &&
+                static_cast<char *>(view.segments.back().iov_base) + view.segments.back().iov_len == base)
+            {
+                view.segments.back().iov_len += to - from;
+            }
+            else
+            {
+                view.segments.push_back({base, to - from});
+            }
+        }
+        view.length = end - offset;
+    }
+
+    view.id = next_view_id++;
+    open_views.emplace(view.id, std::move(opened));
+    return view;
+}
+
+void FileSystem::releaseView(size_t view_id)
+{
+    std::lock_guard<std::recursive_mutex> lock(fs_mutex);
+    auto it = open_views.find(view_id);
+    if (it == open_views.end())
+    {
+        return;
+    }
+    for (size_t block : it->second.pinned)
+    {
+        block_manager.releaseReference(block);
+    }
+    open_views.erase(it);
+}
+
+bool FileSystem::rollbackFile(const std::string &file_name, size_t version_id)
+{
+    std::unique_lock<std::recursive_mutex> lock(fs_mutex);
+    if (!version_graph.fileExists(file_name))
+    {
+        std::cerr << "Error: El archivo '" << file_name << "' no existe.\n";
+        return false;
+    }
+
+    // Verificar si la versión existe
+    const VersionInfo *version_info = version_graph.getVersion(file_name, version_id);
+    if (!version_info)
+    {
+        std::cerr << "Error: La versión " << version_id << " no existe para el archivo '" << file_name << "'.\n";
+        return false;
+    }
+
+    // Restaurar la versión
+    std::vector<char> restored_data;
+    if (!version_graph.restoreVersion(file_name, version_id, restored_data))
+    {
+        std::cerr << "Error durante el rollback.\n";
+        return false;
+    }
+    // No es necesario restaurar los datos, solo actualizar la versión actual
+    std::vector<char> dummy;
+    if (!version_graph.restoreVersion(file_name, version_id, dummy))
+    {
+        std::cerr << "Error durante el rollback.\n";
+        return false;
+    }
+
+    std::cout << "Archivo '" << file_name << "' restaurado a la versión " << version_id << ".\n";
+    size_t sequence = noteMutation(file_name);
+    lock.unlock();
+    finishMutation(sequence);
+    return true;
+}
+
+bool FileSystem::deleteVersion(const std::string &file_name, size_t version_id)
+{
+    std::unique_lock<std::recursive_mutex> lock(fs_mutex);
+    if (!version_graph.fileExists(file_name))
+    {
+        std::cerr << "Error: El archivo '" << file_name << "' no existe.\n";
+        return false;
+    }
+
+    if (!version_graph.removeVersion(file_name, version_id))
+    {
+        return false;
+    }
+
+    std::cout << "Versión " << version_id << " del archivo '" << file_name << "' eliminada.\n";
+    size_t sequence = noteMutation(file_name);
+    lock.unlock();
+    finishMutation(sequence);
+    return true;
+}
+
+void FileSystem::printFileMetadata(const std::string &file_name)
+{
+    std::lock_guard<std::recursive_mutex> lock(fs_mutex);
+    const Metadata *metadata = version_graph.getFileMetadata(file_name);
+    if (!metadata)
+    {
+        std::cerr << "Error: El archivo '" << file_name << "' no existe.\n";
+        return;
+    }
+
+    metadata->printMetadata();
+}
+
+void FileSystem::listFiles()
+{
+    std::lock_guard<std::recursive_mutex> lock(fs_mutex);
+    std::cout << "Archivos en el sistema:\n";
+
+    bool no_files = true;
+    for (const auto &entry : fs::directory_iterator(metadata_dir))
     {
         std::string path = entry.path().string();
         // Reemplazar ends_with con una función compatible con C++17
@@ -338,22 +981,536 @@ void FileSystem::listFiles()
 
 size_t FileSystem::getCurrentVersion(const std::string &file_name)
 {
+    std::lock_guard<std::recursive_mutex> lock(fs_mutex);
     return version_graph.getCurrentVersion(file_name);
 }
 
+bool FileSystem::startScrub(size_t blocks_per_second)
+{
+    return block_manager.startScrub(blocks_per_second);
+}
+
+void FileSystem::stopScrub()
+{
+    block_manager.stopScrub();
+}
+
+FileSystem::ScrubReport FileSystem::getScrubReport() const
+{
+    std::lock_guard<std::recursive_mutex> lock(fs_mutex);
+    ScrubReport report;
+    report.status = block_manager.getScrubStatus();
+    report.damaged = version_graph.findBlockOwners(report.status.corrupt);
+    return report;
+}
+
+void FileSystem::printScrubReport() const
+{
+    if (!block_manager.usingChecksums())
+    {
+        std::cout << "El almacén no guarda sumas de verificación.\n";
+        return;
+    }
+
+    ScrubReport report = getScrubReport();
+    std::cout << "Revisión de sumas " << (report.status.running ? "en curso" : "terminada") << ": "
+              << report.status.position << "/" << report.status.total << " bloques recorridos, "
+              << report.status.verified << " comprobados, " << report.status.corrupt.size() << " dañados\n";
+    for (const auto &owner : report.damaged)
+    {
+        std::cout << "  " << owner.file_name << " v" << owner.version_id << ": bloque " << owner.logical_block
+                  << " (índice físico " << owner.physical_block << ")\n";
+    }
+}
+
+std::vector<FileSystem::FileFragmentation> FileSystem::getFragmentation() const
+{
+    std::lock_guard<std::recursive_mutex> lock(fs_mutex);
+    std::vector<FileFragmentation> report;
+    for (const std::string &file_name : version_graph.getFileNames())
+    {
+        size_t version = version_graph.getCurrentVersion(file_name);
+        const VersionInfo *info = version_graph.getVersion(file_name, version);
+        if (!info)
+        {
+            continue;
+        }
+        FileFragmentation entry{file_name, version, 0, 0, 0.0};
+        entry.extents = countExtents(info->block_list, entry.blocks);
+        if (entry.blocks > 1)
+        {
+            entry.fragmentation = static_cast<double>(entry.extents - 1) / (entry.blocks - 1);
+        }
+        report.push_back(entry);
+    }
+    return report;
+}
+
+void FileSystem::printFragmentation() const
+{
+    std::ios::fmtflags flags = std::cout.flags();
+    std::streamsize precision = std::cout.precision();
+    std::cout << "Fragmentación de la versión actual de cada archivo:\n";
+    for (const auto &entry : getFragmentation())
+    {
+        std::cout << "  " << entry.file_name << " v" << entry.version_id << ": " << entry.blocks
+                  << " bloques en " << entry.extents << " rachas (fragmentación " << std::fixed
+                  << std::setprecision(2) << entry.fragmentation << ")\n";
+    }
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+
+    DefragStatus status = getDefragStatus();
+    if (status.running || status.files_total > 0)
+    {
+        std::cout << "Desfragmentación " << (status.running ? "en curso" : "terminada") << ": "
+                  << status.files_done << "/" << status.files_total << " archivos, "
+                  << status.relocated_blocks << " bloques reubicados\n";
+    }
+}
+
+size_t FileSystem::relocateBatch(const std::string &file_name, size_t &next_logical, size_t &hint, bool &more)
+{
+    // 1. Con el mutex: bloques físicos distintos de la tanda, en orden lógico. Se fijan con
+    //    una referencia propia para que nadie los libere (y los reutilice) mientras se copian.
+    std::vector<size_t> old_blocks;
+    size_t old_extents;
+    {
+        std::lock_guard<std::recursive_mutex> lock(fs_mutex);
+        const VersionInfo *info = version_graph.getVersion(file_name, version_graph.getCurrentVersion(file_name));
+        if (!info || next_logical >= info->block_list.size())
+        {
+            more = false;
+            return 0;
+        }
+        size_t end = std::min(next_logical + DEFRAG_BATCH, info->block_list.size());
+        std::unordered_set<size_t> seen;
+        for (size_t i = next_logical; i < end; i++)
+        {
+            size_t block = info->block_list[i];
+            if (block != HOLE_BLOCK && seen.insert(block).second)
+            {
+                old_blocks.push_back(block);
+            }
+        }
+        next_logical = end;
+        more = end < info->block_list.size();
+        if (old_blocks.empty())
+        {
+            return 0;
+        }
+
+        // Una tanda ya contigua y a continuación de la anterior se queda donde está
+        size_t blocks;
+        old_extents = countExtents(old_blocks, blocks);
+        if (old_extents == 1 && (hint == 0 || old_blocks.front() == hint))
+        {
+            hint = old_blocks.back() + 1;
+            return 0;
+        }
+        for (size_t block : old_blocks)
+        {
+            block_manager.addReference(block);
+        }
+    }
+
+    // 2. Sin el mutex: reservar el destino (detrás de la tanda anterior) y copiar. Solo se
+    //    copia si el destino queda en menos rachas que el origen.
+    std::vector<BlockManager::Extent> extents = block_manager.allocateExtent(old_blocks.size(), hint);
+    std::vector<size_t> new_blocks;
+    for (const auto &extent : extents)
+    {
+        for (size_t j = 0; j < extent.length; j++)
+        {
+            new_blocks.push_back(extent.start + j);
+        }
+    }
+    for (size_t block : new_blocks)
+    {
+        block_manager.addReference(block);
+    }
+    bool copied = !new_blocks.empty() && extents.size() < old_extents;
+    if (copied)
+    {
+        // Un bloque dañado no se copia: la suma nueva daría por buenos datos corruptos
+        std::vector<char> buffer(old_blocks.size() * block_size);
+        copied = block_manager.readBlocksAsync(old_blocks, buffer.data()).get() &&
+                 block_manager.writeBlocksAsync(new_blocks, buffer.data()).get();
+        if (copied && block_manager.dedupEnabled())
+        {
+            for (size_t j = 0; j < new_blocks.size(); j++)
+            {
+                const char *content = buffer.data() + j * block_size;
+                block_manager.registerContent(new_blocks[j], DedupIndex::fingerprint(content, block_size));
+            }
+        }
+    }
+
+    // 3. Con el mutex: sustituir los bloques en todas las versiones que aún los usan
+    //    (incluidas las publicadas durante la copia)
+    size_t sequence = 0;
+    if (copied)
+    {
+        std::unordered_map<size_t, size_t> moves;
+        for (size_t j = 0; j < old_blocks.size(); j++)
+        {
+            moves[old_blocks[j]] = new_blocks[j];
+        }
+        std::lock_guard<std::recursive_mutex> lock(fs_mutex);
+        std::vector<std::string> changed_files;
+        version_graph.relocateBlocks(moves, &changed_files);
+        for (const std::string &changed : changed_files)
+        {
+            sequence = noteMutation(changed);
+        }
+    }
+    hint = copied ? new_blocks.back() + 1 : old_blocks.back() + 1;
+
+    // Soltar las fijaciones. Los bloques viejos siguen referenciados hasta que la lista nueva sea
+    // durable (relocateBlocks aplaza esas referencias al próximo vaciado), así que no quedan libres
+    // aquí; los nuevos sí, si no se llegaron a publicar
+    for (size_t block : old_blocks)
+    {
+        block_manager.releaseReference(block);
+    }
+    for (size_t block : new_blocks)
+    {
+        block_manager.releaseReference(block);
+    }
+    if (sequence > 0)
+    {
+        finishMutation(sequence);
+    }
+    return copied ? old_blocks.size() : 0;
+}
+
+size_t FileSystem::defragmentFile(const std::string &file_name)
+{
+    {
+        std::lock_guard<std::recursive_mutex> lock(fs_mutex);
+        if (!version_graph.fileExists(file_name))
+        {
+            std::cerr << "Error: El archivo '" << file_name << "' no existe.\n";
+            return 0;
+        }
+    }
+
+    size_t next_logical = 0;
+    size_t hint = 0;
+    size_t relocated = 0;
+    bool more = true;
+    while (more)
+    {
+        relocated += relocateBatch(file_name, next_logical, hint, more);
+    }
+    return relocated;
+}
+
+bool FileSystem::startDefrag(size_t blocks_per_second, double threshold)
+{
+    std::lock_guard<std::mutex> control(defrag_control);
+    {
+        std::lock_guard<std::mutex> lock(defrag_mutex);
+        if (defrag_status.running)
+        {
+            return false;
+        }
+    }
+    // Recoger el hilo de una pasada anterior ya terminada
+    if (defrag_thread.joinable())
+    {
+        defrag_thread.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(defrag_mutex);
+        defrag_status = DefragStatus{true, 0, 0, 0};
+        defrag_stop = false;
+    }
+    defrag_thread = std::thread(&FileSystem::defragLoop, this, blocks_per_second, threshold);
+    return true;
+}
+
+void FileSystem::stopDefrag()
+{
+    std::lock_guard<std::mutex> control(defrag_control);
+    {
+        std::lock_guard<std::mutex> lock(defrag_mutex);
+        defrag_stop = true;
+    }
+    defrag_wake.notify_all();
+    if (defrag_thread.joinable())
+    {
+        defrag_thread.join();
+    }
+}
+
+FileSystem::DefragStatus FileSystem::getDefragStatus() const
+{
+    std::lock_guard<std::mutex> lock(defrag_mutex);
+    return defrag_status;
+}
+
+void FileSystem::defragLoop(size_t blocks_per_second, double threshold)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::string> candidates;
+    for (const auto &entry : getFragmentation())
+    {
+        if (entry.fragmentation > threshold)
+        {
+            candidates.push_back(entry.file_name);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(defrag_mutex);
+        defrag_status.files_total = candidates.size();
+    }
+
+    size_t relocated = 0;
+    bool stopped = false;
+    for (const std::string &file_name : candidates)
+    {
+        size_t next_logical = 0;
+        size_t hint = 0;
+        bool more = true;
+        while (more && !stopped)
+        {
+            relocated += relocateBatch(file_name, next_logical, hint, more);
+
+            std::unique_lock<std::mutex> lock(defrag_mutex);
+            defrag_status.relocated_blocks = relocated;
+            // Limitar el ritmo: el bloque n no se copia antes de start + n / blocks_per_second
+            if (blocks_per_second > 0)
+            {
+                auto deadline = start + std::chrono::microseconds(relocated * 1000000 / blocks_per_second);
+                defrag_wake.wait_until(lock, deadline, [this]() { return defrag_stop; });
+            }
+            stopped = defrag_stop;
+        }
+        if (stopped)
+        {
+            break;
+        }
+        std::lock_guard<std::mutex> lock(defrag_mutex);
+        defrag_status.files_done++;
+    }
+
+    std::lock_guard<std::mutex> lock(defrag_mutex);
+    defrag_status.running = false;
+}
+
 void FileSystem::sync()
 {
-    // Sincronizar bloques
+    // Vaciado con punto de control de todos los archivos, no solo de los pendientes
+    size_t sequence;
+    {
+        std::lock_guard<std::recursive_mutex> lock(fs_mutex);
+        for (const std::string &file_name : version_graph.getFileNames())
+        {
+            dirty_files.insert(file_name);
+        }
+        checkpoint_requested = true;
+        sequence = ++mutation_seq;
+    }
+    waitDurable(sequence);
+
+    std::cout << "Datos sincronizados a disco.\n";
+}
+
+void FileSystem::setDurability(const DurabilityOptions &options)
+{
+    std::lock_guard<std::mutex> control(durability_control);
+
+    // Parar el hilo de vaciado si lo hay; lo pendiente se guarda antes de cambiar de modo
+    {
+        std::lock_guard<std::mutex> lock(durability_mutex);
+        flusher_stop = true;
+    }
+    flusher_wake.notify_all();
+    if (flusher_thread.joinable())
+    {
+        flusher_thread.join();
+    }
+    barrier();
+
+    std::lock_guard<std::mutex> lock(durability_mutex);
+    durability = options;
+    durability.group_interval_ms = std::max<size_t>(options.group_interval_ms, 1);
+    durability.group_ops = std::max<size_t>(options.group_ops, 1);
+    flusher_stop = false;
+    if (durability.mode == DurabilityMode::GroupCommit)
+    {
+        flusher_thread = std::thread(&FileSystem::flusherLoop, this);
+    }
+}
+
+FileSystem::DurabilityOptions FileSystem::getDurability() const
+{
+    std::lock_guard<std::mutex> lock(durability_mutex);
+    return durability;
+}
+
+bool FileSystem::barrier()
+{
+    return waitDurable(mutation_seq.load());
+}
+
+size_t FileSystem::noteMutation(const std::string &file_name)
+{
+    dirty_files.insert(file_name);
+    return ++mutation_seq;
+}
+
+void FileSystem::finishMutation(size_t sequence)
+{
+    std::unique_lock<std::mutex> lock(durability_mutex);
+    if (durability.mode == DurabilityMode::Immediate)
+    {
+        lock.unlock();
+        waitDurable(sequence);
+    }
+    else if (durability.mode == DurabilityMode::GroupCommit && sequence - durable_seq >= durability.group_ops)
+    {
+        flusher_wake.notify_one();
+    }
+}
+
+bool FileSystem::waitDurable(size_t sequence)
+{
+    // Compromiso en grupo: si hay un vaciado en curso se espera a que termine (puede no cubrir
+    // este cambio si empezó antes); si no, este hilo vacía todo lo pendiente, también lo de
+    // quienes lleguen mientras tanto
+    std::unique_lock<std::mutex> lock(durability_mutex);
+    while (durable_seq < sequence)
+    {
+        if (flushing)
+        {
+            flush_done.wait(lock);
+            continue;
+        }
+        flushing = true;
+        lock.unlock();
+        size_t flushed_sequence = 0;
+        bool flushed = flushPending(flushed_sequence);
+        lock.lock();
+        flushing = false;
+        if (flushed)
+        {
+            durable_seq = std::max(durable_seq, flushed_sequence);
+        }
+        flush_done.notify_all();
+        if (!flushed)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FileSystem::flushPending(size_t &flushed_sequence)
+{
+    // 1. Con fs_mutex: los registros de los cambios pendientes y, si toca punto de control, la
+    //    foto de los metadatos de los archivos cambiados desde el anterior. Los bloques de todas
+    //    las versiones ya estaban escritos al publicarse
+    size_t checkpoint_bytes = getDurability().checkpoint_bytes;
+    std::vector<char> records;
+    std::vector<size_t> releases;
+    VersionGraph::MetadataSnapshot snapshot;
+    bool checkpoint;
+    {
+        std::lock_guard<std::recursive_mutex> lock(fs_mutex);
+        flushed_sequence = mutation_seq.load();
+        records = version_graph.takeLogRecords();
+        releases = version_graph.takeDeferredReleases();
+        checkpoint = checkpoint_requested || !metadata_log.isOpen() ||
+                     metadata_log.size() + records.size() >= checkpoint_bytes;
+        if (checkpoint)
+        {
+            std::vector<std::string> file_names(dirty_files.begin(), dirty_files.end());
+            dirty_files.clear();
+            checkpoint_requested = false;
+            snapshot = version_graph.snapshotFiles(file_names);
+        }
+    }
+
+    // 2. Sin él (las demás llamadas siguen): un fsync para los bloques y el mapa y otro para
+    //    añadir los registros al final del registro de metadatos. Con esto el cambio ya es durable
     block_manager.sync();
+    bool logged = records.empty() || !metadata_log.isOpen() || metadata_log.append(records);
+    if (!logged)
+    {
+        std::lock_guard<std::recursive_mutex> lock(fs_mutex);
+        version_graph.restoreLogRecords(std::move(records));
+    }
 
-    // Guardar metadatos
-    version_graph.saveMetadata(metadata_dir);
+    // 3. Punto de control: los .meta de la foto, con current_versions.meta el último, y vaciar el
+    //    registro. Si la caída llega a medias, al reproducir el registro entero sobre los .meta
+    //    se vuelve al mismo estado
+    bool saved = false;
+    if (checkpoint && logged)
+    {
+        saved = snapshot.files.empty() || VersionGraph::writeSnapshot(metadata_dir, snapshot);
+        if (saved && metadata_log.isOpen() && !metadata_log.reset())
+        {
+            std::cerr << "Aviso: No se pudo vaciar el registro de metadatos\n";
+        }
+    }
 
-    std::cout << "Datos sincronizados a disco.\n";
+    // 4. Con los cambios ya durables, soltar las referencias de las versiones eliminadas,
+    //    reemplazadas o reubicadas: solo ahora pueden quedar libres (y perforarse) sus bloques.
+    //    Sin registro, solo el punto de control hace durable el cambio
+    bool durable = logged && (saved || metadata_log.isOpen());
+    if (durable)
+    {
+        version_graph.releaseDeferred(releases);
+    }
+
+    // 5. Anotar lo guardado; si no hubo punto de control (o falló), esos archivos siguen pendientes
+    //    de él
+    std::lock_guard<std::recursive_mutex> lock(fs_mutex);
+    if (!durable)
+    {
+        version_graph.restoreDeferredReleases(releases);
+    }
+    if (saved)
+    {
+        version_graph.markSaved(snapshot);
+    }
+    else
+    {
+        for (const auto &file : snapshot.files)
+        {
+            dirty_files.insert(file.first);
+        }
+        if (checkpoint && logged)
+        {
+            checkpoint_requested = true;
+        }
+    }
+    return durable;
+}
+
+void FileSystem::flusherLoop()
+{
+    std::unique_lock<std::mutex> lock(durability_mutex);
+    while (!flusher_stop)
+    {
+        // Vaciar al cumplirse el intervalo o al acumularse group_ops cambios sin guardar
+        flusher_wake.wait_for(lock, std::chrono::milliseconds(durability.group_interval_ms), [this]
+                              { return flusher_stop || mutation_seq.load() - durable_seq >= durability.group_ops; });
+        if (mutation_seq.load() == durable_seq)
+        {
+            continue;
+        }
+        lock.unlock();
+        waitDurable(mutation_seq.load());
+        lock.lock();
+    }
 }
 
 void FileSystem::inspectBlocks(const std::string &file_name)
 {
+    std::lock_guard<std::recursive_mutex> lock(fs_mutex);
     if (!version_graph.fileExists(file_name))
     {
         std::cout << "El archivo no existe.\n";
@@ -376,17 +1533,22 @@ void FileSystem::inspectBlocks(const std::string &file_name)
     for (size_t i = 0; i < version_info->block_list.size(); i++)
     {
         size_t block_index = version_info->block_list[i];
+        if (block_index == HOLE_BLOCK)
+        {
+            std::cout << "Bloque " << i << ": hueco (se lee como ceros, sin bloque físico)\n\n";
+            continue;
+        }
 
         // Leer bloque
-        char buffer[BLOCK_SIZE];
-        block_manager.readBlock(block_index, buffer, BLOCK_SIZE);
+        std::vector<char> buffer(block_size);
+        block_manager.readBlock(block_index, buffer.data(), block_size);
 
         // Mostrar información del bloque
         std::cout << "Bloque " << i << " (índice físico " << block_index << "):\n";
 
         // Mostrar primeros 64 bytes como texto (o menos si contiene nulos)
         std::cout << "  Contenido (texto): '";
-        for (size_t j = 0; j < 64 && j < BLOCK_SIZE; j++)
+        for (size_t j = 0; j < 64 && j < block_size; j++)
         {
             if (buffer[j] == '\0')
             {
@@ -406,7 +1568,7 @@ void FileSystem::inspectBlocks(const std::string &file_name)
 
         // Mostrar primeros 16 bytes como hexadecimal
         std::cout << "  Primeros bytes (hex): ";
-        for (size_t j = 0; j < 16 && j < BLOCK_SIZE; j++)
+        for (size_t j = 0; j < 16 && j < block_size; j++)
         {
             std::cout << std::hex << std::setw(2) << std::setfill('0')
                       << static_cast<int>(static_cast<unsigned char>(buffer[j])) << " ";
@@ -414,91 +1576,3 @@ void FileSystem::inspectBlocks(const std::string &file_name)
         std::cout << std::dec << "\n\n";
     }
 }
-
-// Métodos auxiliares
-
-std::vector<std::pair<size_t, std::vector<char>>> FileSystem::splitIntoBlocks(const std::vector<char> &data)
-{
-    std::vector<std::pair<size_t, std::vector<char>>> blocks;
-
-    size_t num_blocks = (data.size() + block_size - 1) / block_size; // Redondear hacia arriba
-
-    for (size_t i = 0; i < num_blocks; i++)
-    {
-        size_t start = i * block_size;
-        size_t end = std::min(start + block_size, data.size());
-
-        std::vector<char> block_data(data.begin() + start, data.begin() + end);
-        // Si el último bloque no está completo, rellenar con ceros
-        if (block_data.size() < block_size)
-        {
-            block_data.resize(block_size, '\0');
-        }
-
-        blocks.push_back({i, block_data});
-    }
-
-    return blocks;
-}
-
-std::vector<size_t> FileSystem::calculateModifiedBlocks(const std::vector<char> &oldData, const std::vector<char> &newData)
-{
-    std::vector<size_t> modified_blocks;
-
-    // Calcular cuántos bloques lógicos hay en cada versión
-    size_t old_num_blocks = (oldData.size() + block_size - 1) / block_size;
-    size_t new_num_blocks = (newData.size() + block_size - 1) / block_size;
-
-    // Máximo número de bloques entre ambas versiones
-    size_t max_num_blocks = std::max(old_num_blocks, new_num_blocks);
-
-    for (size_t i = 0; i < max_num_blocks; i++)
-    {
-        size_t old_start = i * block_size;
-        size_t new_start = i * block_size;
-
-        // Verificar si el bloque existe en ambas versiones
-        bool block_in_old = old_start < oldData.size();
-        bool block_in_new = new_start < newData.size();
-
-        // Si el bloque solo existe en una versión, ha sido modificado
-        if (block_in_old != block_in_new)
-        {
-            modified_blocks.push_back(i);
-            continue;
-        }
-
-        // Si el bloque existe en ambas versiones, comparar contenido
-        if (block_in_old && block_in_new)
-        {
-            size_t old_end = std::min(old_start + block_size, oldData.size());
-            size_t new_end = std::min(new_start + block_size, newData.size());
-
-            // Si los tamaños son diferentes, el bloque ha sido modificado
-            if (old_end - old_start != new_end - new_start)
-            {
-                modified_blocks.push_back(i);
-                continue;
-            }
-
-            // Comparar contenido byte a byte
-            bool different = false;
-            for (size_t j = 0; j < old_end - old_start; j++)
-            {
-                if (oldData[old_start + j] != newData[new_start + j])
-                {
-                    different = true;
-                    break;
-                }
-            }
-
-            if (different)
-            {
-                modified_blocks.push_back(i);
-            }
-        }
-    }
-
-    return modified_blocks;
-
-}
\ No newline at end of file
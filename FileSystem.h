@@ -2,15 +2,23 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <map>
+#include <unordered_set>
+#include <atomic>
 #include <fstream>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 #include "BlockManager.h"
 #include "VersionGraph.h"
+#include "MetadataLog.h"
 
 class FileSystem
 {
 public:
-    // Constructor con ruta de almacenamiento y tamaño (en MB)
-    FileSystem(const std::string &storage_path, size_t storage_size_mb = 100);
+    // Constructor con ruta de almacenamiento, tamaño (en MB) y opciones del almacén de bloques
+    FileSystem(const std::string &storage_path, size_t storage_size_mb = 100,
+               const StorageOptions &options = {});
     ~FileSystem();
 
     // Crear un nuevo archivo
@@ -19,9 +27,55 @@ public:
     // Escribir datos en un archivo (implementando COW)
     bool write(const std::string &file_name, size_t offset, const std::vector<char> &data);
 
+    // Sesiones de escritura: muchas escrituras sobre la versión actual de un archivo abierto que
+    // se publican juntas como una sola versión. Los bloques lógicos modificados se guardan en
+    // memoria y solo al confirmar se reservan y se escriben, de una vez. beginSession devuelve el
+    // identificador de la sesión (0 si falla). commitSession falla si la versión actual cambió
+    // desde beginSession (otra escritura o un rollback); tanto si confirma como si no, la sesión
+    // termina. abortSession la descarta sin reservar ni escribir ningún bloque.
+    size_t beginSession(const std::string &file_name);
+    bool sessionWrite(size_t session_id, size_t offset, const std::vector<char> &data);
+    bool commitSession(size_t session_id);
+    void abortSession(size_t session_id);
+
+    // Confirmar varias sesiones (de archivos distintos) de forma atómica: o se publican todas las
+    // versiones nuevas o ninguna. Al volver ya son durables: se sincronizan los bloques y los
+    // registros de todas las versiones van al registro de metadatos en un mismo grupo, cuyo
+    // registro de confirmación es el punto de confirmación. Al arrancar solo se reproducen los
+    // grupos confirmados, así que tras una caída se ven todas o ninguna. Los .meta (con el
+    // renombrado de current_versions.meta) solo se reescriben en el punto de control, y sin
+    // registro de metadatos ese renombrado pasa a ser el punto de confirmación.
+    // Como commitSession, las sesiones terminan aunque falle.
+    bool commitSessions(const std::vector<size_t> &session_ids);
+
     // Leer el contenido completo de un archivo
     std::vector<char> read(const std::string &file_name);
 
+    // Leer 'length' bytes desde 'offset' en 'buffer' leyendo solo los bloques que cubren el rango,
+    // de la versión actual o de 'version_id' (0 = actual). Devuelve los bytes copiados, que son
+    // menos de 'length' si el rango pasa del final del archivo (0 también si hay un error).
+    size_t read(const std::string &file_name, size_t offset, size_t length, char *buffer, size_t version_id = 0);
+
+    // Tamaño de la versión actual (o de 'version_id') hasta su último byte no nulo
+    size_t getFileSize(const std::string &file_name, size_t version_id = 0);
+
+    // Vista de solo lectura sobre un rango de una versión, como segmentos iovec en orden.
+    // Solo evita la copia con el backend MemoryMapped: ahí los segmentos apuntan directamente al
+    // mapeo del almacén (los bloques físicamente consecutivos forman un solo segmento). Con el
+    // backend de descriptor, y para los bloques comprimidos con cualquier backend, la vista SÍ
+    // copia: los bloques se leen en un lote (desde la caché o el disco) a un buffer propio de
+    // la vista, así que cuesta lo mismo que read() más la memoria del buffer. Los huecos apuntan
+    // a un bloque de ceros compartido. Los bloques quedan fijados con una referencia hasta
+    // releaseView, de modo que siguen siendo válidos aunque se borre o se desfragmente su versión.
+    struct ReadView
+    {
+        size_t id;                  // 0 = no se pudo abrir
+        std::vector<iovec> segments;
+        size_t length;              // Suma de los segmentos (menos que lo pedido al pasar del final)
+    };
+    ReadView openView(const std::string &file_name, size_t offset, size_t length, size_t version_id = 0);
+    void releaseView(size_t view_id);
+
     // Abrir un archivo
     bool open(const std::string &filename);
 
@@ -31,6 +85,10 @@ public:
     // Restaurar un archivo a    una versión anterior
     bool rollbackFile(const std::string &file_name, size_t version_id);
 
+    // Eliminar una versión (no actual) de un archivo. Los bloques que solo ella usaba quedan libres
+    // en cuanto la eliminación es durable (en el siguiente vaciado), no antes
+    bool deleteVersion(const std::string &file_name, size_t version_id);
+
     // Mostrar metadatos de un archivo
     void printFileMetadata(const std::string &file_name);
 
@@ -40,12 +98,85 @@ public:
     // Obtener el número de la versión actual de un archivo
     size_t getCurrentVersion(const std::string &file_name);
 
-    // Sincronizar todos los cambios a disco
+    // Sincronizar todos los cambios a disco (bloques y metadatos de todos los archivos)
     void sync();
 
+    // Durabilidad. Cada llamada que cambia un archivo lo deja pendiente de guardar; un vaciado
+    // hace un único fsync del almacén y guarda solo los metadatos de los archivos pendientes.
+    // Las peticiones simultáneas se agrupan: quien llega mientras otro vacía espera a que
+    // termine, y el vaciado siguiente cubre a todos los que esperaban.
+    //  - Immediate: cada llamada que modifica vuelve cuando su cambio ya es durable
+    //  - GroupCommit: un hilo vacía cada group_interval_ms o al acumular group_ops cambios
+    //  - OnDemand: solo se vacía con barrier(), sync(), close() o commitSessions()
+    // Cada vaciado añade los cambios al registro de metadatos (un fsync secuencial); los .meta
+    // completos solo se reescriben en un punto de control, cuando el registro pasa de
+    // checkpoint_bytes o en sync()
+    enum class DurabilityMode
+    {
+        Immediate,
+        GroupCommit,
+        OnDemand
+    };
+    struct DurabilityOptions
+    {
+        DurabilityMode mode = DurabilityMode::OnDemand;
+        size_t group_interval_ms = 50;
+        size_t group_ops = 64;
+        size_t checkpoint_bytes = 4 * 1024 * 1024;
+    };
+    void setDurability(const DurabilityOptions &options);
+    DurabilityOptions getDurability() const;
+
+    // Esperar a que todos los cambios terminados antes de la llamada sean durables
+    bool barrier();
+
     // Para depuración: inspeccionar contenido real de bloques
     void inspectBlocks(const std::string &file_name);
 
+    // Revisión de sumas en segundo plano (ver BlockManager::startScrub). El informe traduce
+    // los bloques dañados a las versiones de archivo que los usan.
+    bool startScrub(size_t blocks_per_second = 0);
+    void stopScrub();
+    struct ScrubReport
+    {
+        BlockManager::ScrubStatus status;
+        std::vector<VersionGraph::BlockOwner> damaged;
+    };
+    ScrubReport getScrubReport() const;
+    void printScrubReport() const;
+
+    // Fragmentación de la versión actual de cada archivo: cuántas rachas de bloques
+    // físicamente consecutivos hacen falta para leerlo entero en orden
+    struct FileFragmentation
+    {
+        std::string file_name;
+        size_t version_id;
+        size_t blocks;        // Bloques físicos (sin contar huecos)
+        size_t extents;       // Rachas de bloques consecutivos
+        double fragmentation; // 0 = contiguo, 1 = ningún bloque sigue al anterior
+    };
+    std::vector<FileFragmentation> getFragmentation() const;
+    void printFragmentation() const;
+
+    // Desfragmentación en línea: copia los bloques de la versión actual a rachas contiguas y
+    // sustituye los bloques viejos en todas las versiones (de cualquier archivo) que los
+    // comparten. Trabaja por tandas; entre tandas el sistema sigue atendiendo otras llamadas.
+    // defragmentFile lo hace ahora con un archivo y devuelve los bloques reubicados.
+    size_t defragmentFile(const std::string &file_name);
+
+    // Pasada en segundo plano por los archivos con fragmentación mayor que 'threshold',
+    // copiando como mucho blocks_per_second bloques por segundo (0 = sin límite)
+    bool startDefrag(size_t blocks_per_second = 0, double threshold = 0.0);
+    void stopDefrag();
+    struct DefragStatus
+    {
+        bool running;
+        size_t files_done;
+        size_t files_total;
+        size_t relocated_blocks;
+    };
+    DefragStatus getDefragStatus() const;
+
     // Función para mostrar estadísticas de memoria
     struct GlobalMemoryUsage
     {
@@ -66,17 +197,98 @@ private:
 
     // Helpers (privados)
     bool isOpen(const std::string &filename) const;
+    bool checkWritable(const std::string &file_name) const; // Existe y está abierto (si no, informa)
 
     std::string storage_path;   // Ruta del archivo de almacenamiento
     std::string metadata_dir;   // Directorio para metadatos
-    size_t block_size;          // Tamaño de bloque (constante)
+    size_t block_size;          // Tamaño de bloque del almacén
     BlockManager block_manager; // Gestor de bloques
     VersionGraph version_graph; // Grafo de versiones
+    MetadataLog metadata_log;   // Cambios de metadatos desde el último punto de control
+
+    // Las llamadas públicas lo toman completo; el desfragmentador solo para leer la lista
+    // de bloques y para publicar cada tanda reubicada (la copia se hace sin él)
+    mutable std::recursive_mutex fs_mutex; // Protege version_graph, open_files y las sesiones
+
+    // Desfragmentador en segundo plano
+    std::mutex defrag_control;             // Serializa startDefrag/stopDefrag
+    mutable std::mutex defrag_mutex;       // Protege defrag_status y defrag_stop
+    std::condition_variable defrag_wake;   // Despierta al hilo para que pare
+    std::thread defrag_thread;
+    DefragStatus defrag_status;
+    bool defrag_stop;
+    void defragLoop(size_t blocks_per_second, double threshold);
+
+    // Vistas abiertas: bloques fijados y buffer propio para los que no se leen del mapeo
+    struct OpenView
+    {
+        std::vector<size_t> pinned;
+        std::vector<char> storage;
+    };
+    std::unordered_map<size_t, OpenView> open_views;
+    size_t next_view_id;
+    std::vector<char> zero_block; // Contenido de los huecos en las vistas
+
+    // Bloques lógicos pendientes de una escritura o sesión sobre 'base_version'. Cada bloque
+    // tocado ocupa una posición en 'content' (contenido nuevo) y en 'original' (el de la base)
+    struct WriteSession
+    {
+        std::string file_name;
+        size_t base_version = 0;
+        size_t base_blocks = 0;          // Bloques lógicos de la versión base
+        size_t block_count = 0;          // Bloques lógicos tras las escrituras
+        size_t writes = 0;
+        std::map<size_t, size_t> slots;  // Lógico -> posición en los buffers
+        std::vector<char> original;
+        std::vector<char> content;
+    };
+    std::unordered_map<size_t, WriteSession> sessions;
+    size_t next_session_id;
+    bool startSession(const std::string &file_name, WriteSession &session) const;
+    bool stageWrite(WriteSession &session, size_t offset, const std::vector<char> &data);
+    // Versión ya escrita en bloques nuevos, pendiente de añadirse al grafo
+    struct PreparedVersion
+    {
+        std::string file_name;
+        size_t version_id = 0;
+        size_t parent_version = 0;
+        std::vector<size_t> block_list;
+        std::vector<size_t> modified_blocks;
+        std::vector<size_t> allocated_blocks;       // Reservados por esta versión
+        std::vector<BlockFingerprint> fingerprints; // De los primeros allocated_blocks (deduplicación)
+    };
+    // Reservar y escribir los bloques cambiados de una sesión (sin publicarla todavía)
+    bool prepareSession(const WriteSession &session, PreparedVersion &prepared);
+    void discardPrepared(PreparedVersion &prepared);
+    void applyPrepared(const PreparedVersion &prepared);
+    // prepareSession + applyPrepared; devuelve el número de la versión nueva en 'new_version'
+    bool publishSession(const WriteSession &session, size_t &new_version);
 
-    // Método auxiliar para dividir datos en bloques
-    std::vector<std::pair<size_t, std::vector<char>>> splitIntoBlocks(const std::vector<char> &data);
+    // Durabilidad (ver setDurability). dirty_files se protege con fs_mutex; el resto, con durability_mutex
+    std::unordered_set<std::string> dirty_files; // Con cambios desde el último punto de control
+    bool checkpoint_requested;                    // El próximo vaciado reescribe los .meta (sync)
+    std::atomic<size_t> mutation_seq;             // Cambios terminados (cada uno con su número)
+    std::mutex durability_control;                // Serializa setDurability
+    mutable std::mutex durability_mutex;
+    std::condition_variable flush_done;           // Avisa al terminar cada vaciado
+    std::condition_variable flusher_wake;         // Despierta al hilo de vaciado
+    std::thread flusher_thread;
+    DurabilityOptions durability;
+    size_t durable_seq;                           // Cambios ya durables
+    bool flushing;                                // Hay un vaciado en curso
+    bool flusher_stop;
+    // Anotar un cambio en 'file_name' (con fs_mutex) y devolver su número
+    size_t noteMutation(const std::string &file_name);
+    // Tras soltar fs_mutex: esperar a que sea durable o avisar al hilo, según el modo
+    void finishMutation(size_t sequence);
+    // Esperar a que el cambio 'sequence' sea durable, vaciando si no hay otro vaciado en curso.
+    // Nunca con fs_mutex tomado: el vaciado lo necesita
+    bool waitDurable(size_t sequence);
+    bool flushPending(size_t &flushed_sequence);
+    void flusherLoop();
 
-    // Método para calcular qué bloques se modificaron entre dos versiones
-    std::vector<size_t> calculateModifiedBlocks(const std::vector<char> &oldData,
-                                                const std::vector<char> &newData);
+    // Reubicar la tanda de bloques lógicos que empieza en 'next_logical' de la versión actual,
+    // colocándola a partir de 'hint'. Avanza 'next_logical' y 'hint'; devuelve los bloques
+    // copiados y false en 'more' al llegar al final del archivo.
+    size_t relocateBatch(const std::string &file_name, size_t &next_logical, size_t &hint, bool &more);
 };
\ No newline at end of file
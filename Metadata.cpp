@@ -18,6 +18,10 @@ void Metadata::addVersion(size_t version_id, const std::vector<size_t>& block_li
     version_history[version_id] = version;
 }
 
+void Metadata::putVersion(const VersionInfo& version) {
+    version_history[version.version_id] = version;
+}
+
 const VersionInfo* Metadata::getVersion(size_t version_id) const {
     auto it = version_history.find(version_id);
     if (it != version_history.end()) {
@@ -26,10 +30,48 @@ const VersionInfo* Metadata::getVersion(size_t version_id) const {
     return nullptr;
 }
 
+bool Metadata::removeVersion(size_t version_id) {
+    auto it = version_history.find(version_id);
+    if (it == version_history.end()) {
+        return false;
+    }
+    
+    size_t parent = it->second.parent_version;
+    version_history.erase(it);
+    
+    // Mantener el grafo conectado: las versiones hijas heredan el padre
+    for (auto& [id, version] : version_history) {
+        if (version.parent_version == version_id) {
+            version.parent_version = parent;
+        }
+    }
+    return true;
+}
+
 void Metadata::updateFileSize(size_t new_size) {
     file_size = new_size;
 }
 
+std::unordered_map<size_t, size_t> Metadata::replaceBlocks(const std::unordered_map<size_t, size_t>& moves,
+                                                           std::vector<size_t>* changed_versions) {
+    std::unordered_map<size_t, size_t> replaced;
+    for (auto& [id, version] : version_history) {
+        bool changed = false;
+        for (size_t& block : version.block_list) {
+            auto move = moves.find(block);
+            if (move != moves.end()) {
+                replaced[block]++;
+                block = move->second;
+                changed = true;
+            }
+        }
+        if (changed && changed_versions) {
+            changed_versions->push_back(id);
+        }
+    }
+    return replaced;
+}
+
 void Metadata::printMetadata() const {
     std::cout << "Archivo: " << file_name << "\n"
               << "Tamaño: " << file_size << " bytes\n"
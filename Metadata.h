@@ -22,11 +22,23 @@ public:
     void addVersion(size_t version_id, const std::vector<size_t>& block_list, 
                     const std::vector<size_t>& modified_blocks, size_t parent_version = 0);
     
+    // Añadir o reemplazar una versión tal cual, con su marca de tiempo (reproducción del registro)
+    void putVersion(const VersionInfo& version);
+    
     // Obtener información de una versión específica
     const VersionInfo* getVersion(size_t version_id) const;
     
+    // Eliminar una versión; sus hijas pasan a derivar de la versión padre eliminada
+    bool removeVersion(size_t version_id);
+    
     // Actualizar el tamaño del archivo
     void updateFileSize(size_t new_size);
+
+    // Sustituir bloques físicos en las listas de todas las versiones (viejo -> nuevo).
+    // Devuelve cuántas entradas cambiaron por cada bloque viejo; 'changed_versions' (si se pasa)
+    // recibe las versiones con alguna entrada cambiada.
+    std::unordered_map<size_t, size_t> replaceBlocks(const std::unordered_map<size_t, size_t>& moves,
+                                                     std::vector<size_t>* changed_versions = nullptr);
     
     // Imprimir todos los metadatos
     void printMetadata() const;
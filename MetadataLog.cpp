@@ -0,0 +1,159 @@
+#include "MetadataLog.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cstring>
+#include <iostream>
+#include "Crc32c.h"
+
+MetadataLog::MetadataLog() : fd(-1), file_size(0) {
+}
+
+MetadataLog::~MetadataLog() {
+    close();
+}
+
+bool MetadataLog::open(const std::string& path) {
+    close();
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        std::cerr << "Error: No se pudo abrir el registro de metadatos " << path << std::endl;
+        return false;
+    }
+    struct stat info;
+    file_size = fstat(fd, &info) == 0 ? static_cast<size_t>(info.st_size) : 0;
+
+    // Si el registro es nuevo, su entrada en el directorio también tiene que ser durable
+    if (file_size == 0) {
+        std::string dir = path.find('/') == std::string::npos ? "." : path.substr(0, path.rfind('/'));
+        int dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+        if (dir_fd >= 0) {
+            fsync(dir_fd);
+            ::close(dir_fd);
+        }
+    }
+    return true;
+}
+
+void MetadataLog::close() {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    file_size = 0;
+}
+
+void MetadataLog::addRecord(std::vector<char>& out, uint8_t type, const std::vector<char>& payload) {
+    // Cabecera: longitud del contenido, CRC32C de tipo + contenido y tipo
+    uint32_t length = static_cast<uint32_t>(payload.size());
+    uint32_t crc = Crc32c::compute(&type, 1);
+    crc = Crc32c::compute(payload.data(), payload.size(), crc);
+    const char* header_length = reinterpret_cast<const char*>(&length);
+    const char* header_crc = reinterpret_cast<const char*>(&crc);
+    out.insert(out.end(), header_length, header_length + sizeof(length));
+    out.insert(out.end(), header_crc, header_crc + sizeof(crc));
+    out.push_back(static_cast<char>(type));
+    out.insert(out.end(), payload.begin(), payload.end());
+}
+
+void MetadataLog::putNumber(std::vector<char>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+bool MetadataLog::getNumber(const char* data, size_t size, size_t& pos, uint64_t& value) {
+    value = 0;
+    for (unsigned shift = 0; shift < 64 && pos < size; shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(data[pos++]);
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MetadataLog::append(const std::vector<char>& records) {
+    if (fd < 0) {
+        return false;
+    }
+    std::vector<char> group(records);
+    addRecord(group, COMMIT_RECORD, {});
+
+    // Una sola escritura al final y un solo fsync. Si falla a medias, se recorta lo escrito
+    // para que el siguiente grupo no quede detrás de uno incompleto
+    if (pwrite(fd, group.data(), group.size(), file_size) != static_cast<ssize_t>(group.size()) || fdatasync(fd) != 0) {
+        if (ftruncate(fd, file_size) != 0) {
+            std::cerr << "Error: No se pudo recortar el registro de metadatos" << std::endl;
+        }
+        return false;
+    }
+    file_size += group.size();
+    return true;
+}
+
+size_t MetadataLog::replay(const std::function<void(uint8_t type, const char* payload, size_t size)>& apply) {
+    if (fd < 0 || file_size == 0) {
+        return 0;
+    }
+    std::vector<char> data(file_size);
+    if (pread(fd, data.data(), data.size(), 0) != static_cast<ssize_t>(data.size())) {
+        std::cerr << "Error: No se pudo leer el registro de metadatos" << std::endl;
+        return 0;
+    }
+
+    // Recorrer los registros; los de un grupo se aplican al llegar a su confirmación
+    size_t applied = 0;
+    size_t pos = 0;
+    size_t committed_end = 0;
+    std::vector<size_t> group; // Posiciones de los registros del grupo en curso
+    while (pos + HEADER_SIZE <= data.size()) {
+        uint32_t length;
+        uint32_t crc;
+        std::memcpy(&length, data.data() + pos, sizeof(length));
+        std::memcpy(&crc, data.data() + pos + 4, sizeof(crc));
+        if (pos + HEADER_SIZE + length > data.size() ||
+            Crc32c::compute(data.data() + pos + 8, 1 + length) != crc) {
+            break;
+        }
+        uint8_t type = static_cast<uint8_t>(data[pos + 8]);
+        if (type == COMMIT_RECORD) {
+            for (size_t record : group) {
+                uint32_t record_length;
+                std::memcpy(&record_length, data.data() + record, sizeof(record_length));
+                apply(static_cast<uint8_t>(data[record + 8]), data.data() + record + HEADER_SIZE, record_length);
+                applied++;
+            }
+            group.clear();
+            committed_end = pos + HEADER_SIZE + length;
+        } else {
+            group.push_back(pos);
+        }
+        pos += HEADER_SIZE + length;
+    }
+
+    // Descartar la cola que no llegó a confirmarse
+    if (committed_end < file_size) {
+        std::cerr << "Registro de metadatos: se descartan " << (file_size - committed_end)
+                  << " bytes sin confirmar" << std::endl;
+        if (ftruncate(fd, committed_end) == 0) {
+            file_size = committed_end;
+            fdatasync(fd);
+        }
+    }
+    return applied;
+}
+
+bool MetadataLog::reset() {
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, 0) != 0 || fdatasync(fd) != 0) {
+        return false;
+    }
+    file_size = 0;
+    return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+// Registro de escritura anticipada (WAL) de los metadatos: un archivo en el que solo se añade.
+// Cada registro lleva su longitud y su CRC32C; cada append termina con un registro de
+// confirmación y se hace con una sola escritura secuencial y un fsync. Al reproducir solo se
+// aplican los grupos confirmados: una cola rota por una caída se descarta entera (y se recorta).
+// El contenido de los registros lo decide quien los escribe (ver VersionGraph).
+class MetadataLog
+{
+public:
+    MetadataLog();
+    ~MetadataLog();
+
+    // Abrir (o crear) el registro
+    bool open(const std::string &path);
+    void close();
+
+    // Añadir registros ya codificados con addRecord, seguidos de la confirmación, y hacer fsync
+    bool append(const std::vector<char> &records);
+
+    // Pasar a 'apply' cada registro de los grupos confirmados, en orden. Devuelve cuántos hubo
+    size_t replay(const std::function<void(uint8_t type, const char *payload, size_t size)> &apply);
+
+    // Vaciar el registro (tras un punto de control que ya guarda todo lo que contiene)
+    bool reset();
+
+    bool isOpen() const { return fd >= 0; }
+
+    // Bytes que ocupa el registro
+    size_t size() const { return file_size; }
+
+    // Codificación: añadir un registro a 'out' y números enteros en formato variable (LEB128)
+    static void addRecord(std::vector<char> &out, uint8_t type, const std::vector<char> &payload);
+    static void putNumber(std::vector<char> &out, uint64_t value);
+    static bool getNumber(const char *data, size_t size, size_t &pos, uint64_t &value);
+
+private:
+    static constexpr uint8_t COMMIT_RECORD = 0; // Cierra el grupo de un append
+    static constexpr size_t HEADER_SIZE = 9;    // Longitud (4) + CRC (4) + tipo (1)
+
+    int fd;
+    size_t file_size;
+};
@@ -1,12 +1,150 @@
 #include "VersionGraph.h"
+#include "MetadataLog.h"
 #include <iostream>
 #include <fstream>
 #include <filesystem>
-#include <unordered_set>
 #include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace fs = std::filesystem;
 
+namespace
+{
+// Reemplazar 'path' de forma atómica: escribir un temporal, hacer fsync y renombrarlo encima.
+// Tras una caída queda el contenido anterior completo o el nuevo completo, nunca una mezcla.
+bool writeFileAtomic(const std::string &path, const std::vector<char> &data)
+{
+    std::string temp_path = path + ".tmp";
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+    bool written = ::write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size()) && fsync(fd) == 0;
+    written = ::close(fd) == 0 && written;
+    if (!written || std::rename(temp_path.c_str(), path.c_str()) != 0)
+    {
+        ::unlink(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Hacer durables los renombrados hechos dentro de un directorio
+bool syncDirectory(const std::string &dir)
+{
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    bool synced = fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+}
+
+// Tipos de registro del WAL de metadatos. Todos fijan un estado completo (no un cambio relativo),
+// así que reproducir un registro sobre metadatos que ya lo incluyen no cambia nada
+constexpr uint8_t LOG_PUT_VERSION = 1;    // Archivo, versión entera y si pasa a ser la actual
+constexpr uint8_t LOG_SET_CURRENT = 2;    // Archivo y versión actual (rollback)
+constexpr uint8_t LOG_DELETE_VERSION = 3; // Archivo y versión eliminada
+
+void putString(std::vector<char> &out, const std::string &text)
+{
+    MetadataLog::putNumber(out, text.size());
+    out.insert(out.end(), text.begin(), text.end());
+}
+
+bool getString(const char *data, size_t size, size_t &pos, std::string &text)
+{
+    uint64_t length;
+    if (!MetadataLog::getNumber(data, size, pos, length) || length > size - pos)
+    {
+        return false;
+    }
+    text.assign(data + pos, length);
+    pos += length;
+    return true;
+}
+
+// Lista de bloques como rachas (valor inicial, longitud) de valores consecutivos: un archivo
+// contiguo ocupa unos pocos bytes. Los huecos forman sus propias rachas con valor 0
+void putRuns(std::vector<char> &out, const std::vector<size_t> &values)
+{
+    std::vector<std::pair<size_t, size_t>> runs;
+    for (size_t value : values)
+    {
+        if (!runs.empty())
+        {
+            auto &[start, length] = runs.back();
+            bool hole = value == HOLE_BLOCK;
+            if ((hole && start == HOLE_BLOCK) || (!hole && start != HOLE_BLOCK && start + length == value))
+            {
+                length++;
+                continue;
+            }
+        }
+        runs.emplace_back(value, 1);
+    }
+    MetadataLog::putNumber(out, runs.size());
+    for (const auto &[start, length] : runs)
+    {
+        MetadataLog::putNumber(out, start == HOLE_BLOCK ? 0 : start + 1);
+        MetadataLog::putNumber(out, length);
+    }
+}
+
+bool getRuns(const char *data, size_t size, size_t &pos, std::vector<size_t> &values)
+{
+    uint64_t run_count;
+    if (!MetadataLog::getNumber(data, size, pos, run_count))
+    {
+        return false;
+    }
+    values.clear();
+    for (uint64_t r = 0; r < run_count; r++)
+    {
+        uint64_t code;
+        uint64_t length;
+        // El CRC ya descarta registros dañados; el límite solo evita reservar sin medida
+        if (!MetadataLog::getNumber(data, size, pos, code) || !MetadataLog::getNumber(data, size, pos, length) ||
+            length > (uint64_t(1) << 32) - values.size())
+        {
+            return false;
+        }
+        for (uint64_t i = 0; i < length; i++)
+        {
+            values.push_back(code == 0 ? HOLE_BLOCK : code - 1 + i);
+        }
+    }
+    return true;
+}
+
+// Formato de current_versions.meta: número de archivos + (tamaño de nombre + nombre + versión actual) para cada archivo
+std::vector<char> serializeCurrentVersions(const std::unordered_map<std::string, size_t> &current_versions)
+{
+    std::vector<char> data;
+    auto append = [&data](const void *bytes, size_t size)
+    {
+        const char *begin = static_cast<const char *>(bytes);
+        data.insert(data.end(), begin, begin + size);
+    };
+    size_t file_count = current_versions.size();
+    append(&file_count, sizeof(size_t));
+    for (const auto &[file_name, version] : current_versions)
+    {
+        size_t name_len = file_name.size();
+        append(&name_len, sizeof(size_t));
+        append(file_name.data(), name_len);
+        append(&version, sizeof(size_t));
+    }
+    return data;
+}
+}
+
 VersionGraph::VersionGraph(BlockManager &bm) : block_manager(bm)
 {
 }
@@ -23,11 +161,53 @@ void VersionGraph::addVersion(const std::string &file_name, size_t version_id,
         files_metadata[file_name] = Metadata(file_name, 0, "");
     }
 
+    // Cada bloque de la versión gana una referencia (antes de soltar las de una
+    // versión reemplazada con el mismo id, por si comparten bloques)
+    for (size_t block : block_list)
+    {
+        block_manager.addReference(block);
+    }
+    const VersionInfo *replaced = files_metadata[file_name].getVersion(version_id);
+    if (replaced)
+    {
+        deferred_releases.insert(deferred_releases.end(), replaced->block_list.begin(), replaced->block_list.end());
+    }
+
     // Añadir la versión a los metadatos del archivo
     files_metadata[file_name].addVersion(version_id, block_list, modified_blocks, parent_version);
 
     // Actualizar la versión actual del archivo
     current_versions[file_name] = version_id;
+    logVersion(file_name, *files_metadata[file_name].getVersion(version_id), true);
+}
+
+bool VersionGraph::removeVersion(const std::string &file_name, size_t version_id)
+{
+    auto it = files_metadata.find(file_name);
+    if (it == files_metadata.end())
+    {
+        std::cerr << "Error: El archivo no existe en el sistema\n";
+        return false;
+    }
+    if (getCurrentVersion(file_name) == version_id)
+    {
+        std::cerr << "Error: No se puede eliminar la versión actual\n";
+        return false;
+    }
+
+    const VersionInfo *version_info = it->second.getVersion(version_id);
+    if (!version_info)
+    {
+        std::cerr << "Error: La versión solicitada no existe\n";
+        return false;
+    }
+
+    // Las referencias se sueltan cuando la eliminación sea durable: entonces quedan libres los
+    // bloques que solo usaba esta versión
+    deferred_releases.insert(deferred_releases.end(), version_info->block_list.begin(), version_info->block_list.end());
+    it->second.removeVersion(version_id);
+    logChange(LOG_DELETE_VERSION, file_name, version_id);
+    return true;
 }
 
 const VersionInfo *VersionGraph::getVersion(const std::string &file_name, size_t version_id) const
@@ -61,64 +241,145 @@ bool VersionGraph::restoreVersion(const std::string &file_name, size_t version_i
     // Reconstruir el archivo a partir de los bloques de esta versión
     restored_data.clear();
 
-    // Calcular tamaño REAL basado en bloques
-    size_t total_size = version_info->block_list.size() * BLOCK_SIZE;
-    restored_data.reserve(total_size);
-
-    // Leer todos los bloques completos
-    for (size_t block_index : version_info->block_list)
-    {
-        std::vector<char> block_data(BLOCK_SIZE);
-        block_manager.readBlock(block_index, block_data.data(), BLOCK_SIZE);
-        restored_data.insert(restored_data.end(), block_data.begin(), block_data.end());
-    }
+    // Leer todos los bloques completos en un único buffer (lectura vectorizada)
+    size_t block_size = block_manager.getBlockSize();
+    restored_data.resize(version_info->block_list.size() * block_size);
+    block_manager.readBlocks(version_info->block_list, restored_data.data());
 
-    // Ajustar al tamaño real del contenido (hasta el último byte no nulo)
-    size_t actual_size = restored_data.size();
-    while (actual_size > 0 && restored_data[actual_size - 1] == '\0')
+    // Ajustar al tamaño real del contenido (hasta el último byte no nulo): primero se saltan
+    // bloques enteros a cero (huecos finales) y después se recorre el último byte a byte
+    size_t actual_size = withBlockSize(block_size, [&](auto block_bytes)
     {
-        actual_size--;
-    }
+        const size_t size = block_bytes;
+        size_t end = restored_data.size();
+        while (end >= size && BlockManager::isZeroBlock(restored_data.data() + end - size, size))
+        {
+            end -= size;
+        }
+        while (end > 0 && restored_data[end - 1] == '\0')
+        {
+            end--;
+        }
+        return end;
+    });
     restored_data.resize(actual_size);
 
     // Actualizar la versión actual del archivo
-    current_versions[file_name] = version_id;
+    if (getCurrentVersion(file_name) != version_id)
+    {
+        current_versions[file_name] = version_id;
+        logChange(LOG_SET_CURRENT, file_name, version_id);
+    }
 
     std::cout << "Archivo restaurado a la versión " << version_id << std::endl;
     return true;
 }
 
-void VersionGraph::collectGarbage()
+bool VersionGraph::readRange(const std::string &file_name, size_t version_id, size_t offset, size_t length,
+                             char *buffer, size_t &bytes_read) const
 {
-    std::unordered_set<size_t> used_blocks;
+    bytes_read = 0;
+    auto it = files_metadata.find(file_name);
+    const VersionInfo *version_info = it != files_metadata.end() ? it->second.getVersion(version_id) : nullptr;
+    if (!version_info)
+    {
+        std::cerr << "Error: La versión solicitada no existe\n";
+        return false;
+    }
 
-    // Paso 1: Bloques USADOS (versiones accesibles)
-    for (const auto &[file_name, metadata] : files_metadata)
+    // Más allá del último bloque con datos todo son ceros, es decir, fuera del archivo
+    const std::vector<size_t> &blocks = version_info->block_list;
+    size_t block_size = block_manager.getBlockSize();
+    size_t data_blocks = blocks.size();
+    while (data_blocks > 0 && blocks[data_blocks - 1] == HOLE_BLOCK)
     {
-        size_t current_ver = current_versions[file_name];
-        const VersionInfo *version = metadata.getVersion(current_ver);
+        data_blocks--;
+    }
+    size_t end = std::min(offset + length, data_blocks * block_size);
+    if (length == 0 || offset >= end)
+    {
+        return true;
+    }
+
+    // Bloques lógicos [first, last) que cubren el rango
+    size_t first = offset / block_size;
+    size_t last = (end - 1) / block_size + 1;
+    std::vector<size_t> range_blocks(blocks.begin() + first, blocks.begin() + last);
 
-        // Recorrer desde la versión actual hasta la raíz (solo historial accesible)
-        while (version != nullptr)
+    // Un rango alineado que no llega al final se lee directamente en el buffer del llamador
+    bool reaches_end = last == data_blocks;
+    if (!reaches_end && offset % block_size == 0 && end % block_size == 0)
+    {
+        if (!block_manager.readBlocksAsync(range_blocks, buffer).get())
         {
-            for (size_t block : version->block_list)
-            {
-                used_blocks.insert(block);
-            }
-            version = metadata.getVersion(version->parent_version);
+            return false;
         }
+        bytes_read = end - offset;
+        return true;
     }
 
-    // Paso 2: Liberar bloques huérfanos + bloques de archivos eliminados
-    size_t freed_blocks = 0;
-    for (size_t block = 0; block < block_manager.getTotalBlocks(); ++block)
+    std::vector<char> content(range_blocks.size() * block_size);
+    if (!block_manager.readBlocksAsync(range_blocks, content.data()).get())
+    {
+        return false;
+    }
+    if (reaches_end)
     {
-        if (block_manager.isBlockUsed(block) && used_blocks.find(block) == used_blocks.end())
+        // Se leyó el último bloque con datos completo: el archivo acaba en su último byte no nulo
+        size_t file_end = content.size();
+        while (file_end > 0 && content[file_end - 1] == '\0')
+        {
+            file_end--;
+        }
+        end = std::min(end, first * block_size + file_end);
+        if (offset >= end)
+        {
+            return true;
+        }
+    }
+    std::memcpy(buffer, content.data() + (offset - first * block_size), end - offset);
+    bytes_read = end - offset;
+    return true;
+}
+
+size_t VersionGraph::getVersionSize(const std::string &file_name, size_t version_id) const
+{
+    auto it = files_metadata.find(file_name);
+    const VersionInfo *version_info = it != files_metadata.end() ? it->second.getVersion(version_id) : nullptr;
+    if (!version_info)
+    {
+        return 0;
+    }
+
+    // Recorrer hacia atrás los bloques con datos hasta encontrar un byte no nulo
+    const std::vector<size_t> &blocks = version_info->block_list;
+    size_t block_size = block_manager.getBlockSize();
+    std::vector<char> content(block_size);
+    for (size_t i = blocks.size(); i > 0; i--)
+    {
+        if (blocks[i - 1] == HOLE_BLOCK)
+        {
+            continue;
+        }
+        block_manager.readBlock(blocks[i - 1], content.data(), block_size);
+        size_t end = block_size;
+        while (end > 0 && content[end - 1] == '\0')
+        {
+            end--;
+        }
+        if (end > 0)
         {
-            block_manager.freeBlock(block);
-            freed_blocks++;
+            return (i - 1) * block_size + end;
         }
     }
+    return 0;
+}
+
+void VersionGraph::collectGarbage()
+{
+    // Los bloques de versiones eliminadas ya se liberaron al soltar su última referencia;
+    // quedan solo los bloques usados sin ninguna referencia (huérfanos)
+    size_t freed_blocks = block_manager.freeUnreferenced();
 
     std::cout << "GC liberó " << freed_blocks << " bloques (huérfanos o de archivos eliminados)\n";
 }
@@ -130,6 +391,52 @@ size_t VersionGraph::getCurrentVersion(const std::string &file_name) const
 }
 
 bool VersionGraph::saveMetadata(const std::string &metadata_dir)
+{
+    std::vector<std::string> file_names;
+    for (const auto &entry : files_metadata)
+    {
+        file_names.push_back(entry.first);
+    }
+    if (!saveFiles(metadata_dir, file_names))
+    {
+        return false;
+    }
+    releaseDeferred(takeDeferredReleases());
+    return true;
+}
+
+bool VersionGraph::saveFiles(const std::string &metadata_dir, const std::vector<std::string> &file_names)
+{
+    MetadataSnapshot snapshot = snapshotFiles(file_names);
+    if (!writeSnapshot(metadata_dir, snapshot))
+    {
+        return false;
+    }
+    markSaved(snapshot);
+    return true;
+}
+
+VersionGraph::MetadataSnapshot VersionGraph::snapshotFiles(const std::vector<std::string> &file_names) const
+{
+    // Las versiones actuales de estos archivos pasan a ser las de memoria y las demás se quedan
+    // como estaban en disco (sus versiones nuevas aún no están en su .meta)
+    MetadataSnapshot snapshot;
+    snapshot.versions = saved_versions;
+    for (const std::string &file_name : file_names)
+    {
+        auto it = files_metadata.find(file_name);
+        auto current = current_versions.find(file_name);
+        if (it == files_metadata.end() || current == current_versions.end())
+        {
+            continue;
+        }
+        snapshot.files.emplace_back(file_name, it->second.serialize());
+        snapshot.versions[file_name] = current->second;
+    }
+    return snapshot;
+}
+
+bool VersionGraph::writeSnapshot(const std::string &metadata_dir, const MetadataSnapshot &snapshot)
 {
     try
     {
@@ -139,41 +446,23 @@ bool VersionGraph::saveMetadata(const std::string &metadata_dir)
             fs::create_directories(metadata_dir);
         }
 
-        // Guardar metadatos de cada archivo
-        for (const auto &[file_name, metadata] : files_metadata)
+        // Guardar metadatos de cada archivo. Si falla alguno no se toca current_versions.meta:
+        // las versiones nuevas de los demás quedan guardadas pero no son las actuales
+        for (const auto &[file_name, data] : snapshot.files)
         {
-            std::string file_path = metadata_dir + "/" + file_name + ".meta";
-            std::vector<char> serialized_data = metadata.serialize();
-
-            std::ofstream file(file_path, std::ios::binary | std::ios::trunc);
-            if (!file)
+            if (!writeFileAtomic(metadata_dir + "/" + file_name + ".meta", data))
             {
                 std::cerr << "Error: No se pudieron guardar los metadatos de " << file_name << std::endl;
-                continue;
+                return false;
             }
-
-            file.write(serialized_data.data(), serialized_data.size());
-            file.close();
         }
 
-        // Guardar versiones actuales
-        std::string versions_path = metadata_dir + "/current_versions.meta";
-        std::ofstream versions_file(versions_path, std::ios::binary | std::ios::trunc);
-
-        // Formato: número de archivos + (tamaño de nombre + nombre + versión actual) para cada archivo
-        size_t file_count = current_versions.size();
-        versions_file.write(reinterpret_cast<char *>(&file_count), sizeof(size_t));
-
-        for (const auto &[file_name, version] : current_versions)
+        // Guardar versiones actuales: su renombrado publica a la vez todas las de la foto
+        if (!writeFileAtomic(metadata_dir + "/current_versions.meta", serializeCurrentVersions(snapshot.versions)))
         {
-            size_t name_len = file_name.size();
-            versions_file.write(reinterpret_cast<char *>(&name_len), sizeof(size_t));
-            versions_file.write(file_name.data(), name_len);
-            versions_file.write(reinterpret_cast<const char *>(&version), sizeof(size_t));
+            return false;
         }
-
-        versions_file.close();
-        return true;
+        return syncDirectory(metadata_dir);
     }
     catch (const std::exception &e)
     {
@@ -182,7 +471,12 @@ bool VersionGraph::saveMetadata(const std::string &metadata_dir)
     }
 }
 
-bool VersionGraph::loadMetadata(const std::string &metadata_dir)
+void VersionGraph::markSaved(const MetadataSnapshot &snapshot)
+{
+    saved_versions = snapshot.versions;
+}
+
+bool VersionGraph::loadMetadata(const std::string &metadata_dir, MetadataLog *log)
 {
     try
     {
@@ -193,9 +487,13 @@ bool VersionGraph::loadMetadata(const std::string &metadata_dir)
             return false;
         }
 
-        // Limpiar colecciones existentes
+        // Limpiar colecciones existentes (las referencias se recalculan al cargar)
         files_metadata.clear();
         current_versions.clear();
+        saved_versions.clear();
+        log_records.clear();
+        deferred_releases.clear();
+        block_manager.clearReferences();
 
         // Cargar metadatos de cada archivo
         for (const auto &entry : fs::directory_iterator(metadata_dir))
@@ -221,7 +519,7 @@ bool VersionGraph::loadMetadata(const std::string &metadata_dir)
                 std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
                 file.close();
 
-                // Deserializar los metadatos
+                // Deserializar los metadatos (las referencias se cuentan al final)
                 files_metadata[file_name] = Metadata::deserialize(data);
             }
         }
@@ -255,6 +553,30 @@ bool VersionGraph::loadMetadata(const std::string &metadata_dir)
                 }
 
                 versions_file.close();
+                saved_versions = current_versions;
+            }
+        }
+
+        // Reproducir el registro: los cambios confirmados después del último punto de control
+        if (log)
+        {
+            size_t replayed = log->replay([this](uint8_t type, const char *payload, size_t size)
+                                          { applyLogRecord(type, payload, size); });
+            if (replayed > 0)
+            {
+                std::cout << "Registro de metadatos: " << replayed << " cambios recuperados\n";
+            }
+        }
+
+        // Contar las referencias de todas las versiones
+        for (const auto &[file_name, metadata] : files_metadata)
+        {
+            for (const auto &[id, version] : metadata.getVersionHistory())
+            {
+                for (size_t block : version.block_list)
+                {
+                    block_manager.addReference(block);
+                }
             }
         }
 
@@ -267,6 +589,117 @@ bool VersionGraph::loadMetadata(const std::string &metadata_dir)
     }
 }
 
+std::vector<char> VersionGraph::takeLogRecords()
+{
+    std::vector<char> records;
+    records.swap(log_records);
+    return records;
+}
+
+void VersionGraph::restoreLogRecords(std::vector<char> records)
+{
+    records.insert(records.end(), log_records.begin(), log_records.end());
+    log_records.swap(records);
+}
+
+std::vector<size_t> VersionGraph::takeDeferredReleases()
+{
+    std::vector<size_t> releases;
+    releases.swap(deferred_releases);
+    return releases;
+}
+
+void VersionGraph::restoreDeferredReleases(const std::vector<size_t> &releases)
+{
+    deferred_releases.insert(deferred_releases.end(), releases.begin(), releases.end());
+}
+
+void VersionGraph::releaseDeferred(const std::vector<size_t> &releases)
+{
+    for (size_t block : releases)
+    {
+        block_manager.releaseReference(block);
+    }
+}
+
+void VersionGraph::logVersion(const std::string &file_name, const VersionInfo &version, bool make_current)
+{
+    std::vector<char> payload;
+    putString(payload, file_name);
+    MetadataLog::putNumber(payload, version.version_id);
+    MetadataLog::putNumber(payload, version.parent_version);
+    MetadataLog::putNumber(payload, static_cast<uint64_t>(version.timestamp));
+    MetadataLog::putNumber(payload, make_current ? 1 : 0);
+    putRuns(payload, version.block_list);
+    putRuns(payload, version.modified_blocks);
+    MetadataLog::addRecord(log_records, LOG_PUT_VERSION, payload);
+}
+
+void VersionGraph::logChange(uint8_t type, const std::string &file_name, size_t version_id)
+{
+    std::vector<char> payload;
+    putString(payload, file_name);
+    MetadataLog::putNumber(payload, version_id);
+    MetadataLog::addRecord(log_records, type, payload);
+}
+
+void VersionGraph::applyLogRecord(uint8_t type, const char *payload, size_t size)
+{
+    // Se aplica directamente sobre los metadatos, sin tocar referencias (se cuentan al final)
+    size_t pos = 0;
+    std::string file_name;
+    uint64_t version_id;
+    if (!getString(payload, size, pos, file_name) || !MetadataLog::getNumber(payload, size, pos, version_id))
+    {
+        std::cerr << "Error: Registro de metadatos dañado (tipo " << static_cast<int>(type) << ")\n";
+        return;
+    }
+
+    if (type == LOG_PUT_VERSION)
+    {
+        VersionInfo version;
+        uint64_t parent;
+        uint64_t timestamp;
+        uint64_t make_current;
+        if (!MetadataLog::getNumber(payload, size, pos, parent) ||
+            !MetadataLog::getNumber(payload, size, pos, timestamp) ||
+            !MetadataLog::getNumber(payload, size, pos, make_current) ||
+            !getRuns(payload, size, pos, version.block_list) || !getRuns(payload, size, pos, version.modified_blocks))
+        {
+            std::cerr << "Error: Registro de metadatos dañado para " << file_name << "\n";
+            return;
+        }
+        version.version_id = version_id;
+        version.parent_version = parent;
+        version.timestamp = static_cast<time_t>(timestamp);
+        if (files_metadata.find(file_name) == files_metadata.end())
+        {
+            files_metadata[file_name] = Metadata(file_name, 0, "");
+        }
+        files_metadata[file_name].putVersion(version);
+        if (make_current)
+        {
+            current_versions[file_name] = version_id;
+        }
+    }
+    else if (type == LOG_SET_CURRENT)
+    {
+        auto it = files_metadata.find(file_name);
+        if (it != files_metadata.end() && it->second.getVersion(version_id))
+        {
+            current_versions[file_name] = version_id;
+        }
+    }
+    else if (type == LOG_DELETE_VERSION)
+    {
+        auto it = files_metadata.find(file_name);
+        if (it != files_metadata.end())
+        {
+            it->second.removeVersion(version_id);
+        }
+    }
+}
+
 const Metadata *VersionGraph::getFileMetadata(const std::string &file_name) const
 {
     auto it = files_metadata.find(file_name);
@@ -287,6 +720,50 @@ void VersionGraph::updateFileSize(const std::string &file_name, size_t new_size)
     }
 }
 
+std::vector<std::string> VersionGraph::getFileNames() const
+{
+    std::vector<std::string> names;
+    names.reserve(files_metadata.size());
+    for (const auto &[file_name, metadata] : files_metadata)
+    {
+        names.push_back(file_name);
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+size_t VersionGraph::relocateBlocks(const std::unordered_map<size_t, size_t> &moves,
+                                    std::vector<std::string> *changed_files)
+{
+    size_t changed = 0;
+    for (auto &[file_name, metadata] : files_metadata)
+    {
+        // Cada entrada cambiada pasa su referencia del bloque viejo al nuevo. La del nuevo se
+        // añade ya; la del viejo se suelta cuando la lista nueva sea durable
+        std::vector<size_t> changed_versions;
+        std::unordered_map<size_t, size_t> replaced = metadata.replaceBlocks(moves, &changed_versions);
+        if (changed_files && !replaced.empty())
+        {
+            changed_files->push_back(file_name);
+        }
+        for (size_t version_id : changed_versions)
+        {
+            logVersion(file_name, *metadata.getVersion(version_id), false);
+        }
+        for (const auto &[old_block, count] : replaced)
+        {
+            size_t new_block = moves.at(old_block);
+            for (size_t i = 0; i < count; i++)
+            {
+                block_manager.addReference(new_block);
+                deferred_releases.push_back(old_block);
+            }
+            changed += count;
+        }
+    }
+    return changed;
+}
+
 VersionGraph::VersionMemoryUsage VersionGraph::getVersionMemoryUsage() const {
     VersionMemoryUsage usage;
     usage.total_files = files_metadata.size();
@@ -305,4 +782,42 @@ VersionGraph::VersionMemoryUsage VersionGraph::getVersionMemoryUsage() const {
     usage.metadata_size_approx = total_versions * 100; 
     
     return usage;
-}
\ No newline at end of file
+}
+
+std::vector<VersionGraph::BlockOwner> VersionGraph::findBlockOwners(const std::vector<size_t> &physical_blocks) const
+{
+    std::vector<BlockOwner> owners;
+    if (physical_blocks.empty())
+    {
+        return owners;
+    }
+    std::vector<size_t> wanted(physical_blocks);
+    std::sort(wanted.begin(), wanted.end());
+
+    for (const auto &[file_name, meta] : files_metadata)
+    {
+        for (const auto &[version_id, info] : meta.getVersionHistory())
+        {
+            for (size_t i = 0; i < info.block_list.size(); i++)
+            {
+                if (std::binary_search(wanted.begin(), wanted.end(), info.block_list[i]))
+                {
+                    owners.push_back({file_name, version_id, i, info.block_list[i]});
+                }
+            }
+        }
+    }
+    std::sort(owners.begin(), owners.end(), [](const BlockOwner &a, const BlockOwner &b)
+              {
+                  if (a.file_name != b.file_name)
+                  {
+                      return a.file_name < b.file_name;
+                  }
+                  if (a.version_id != b.version_id)
+                  {
+                      return a.version_id < b.version_id;
+                  }
+                  return a.logical_block < b.logical_block;
+              });
+    return owners;
+}
@@ -5,6 +5,8 @@
 #include "BlockManager.h"
 #include "Metadata.h"
 
+class MetadataLog;
+
 class VersionGraph {
 public:
     VersionGraph(BlockManager& block_manager);
@@ -15,20 +17,68 @@ public:
                     const std::vector<size_t>& modified_blocks,
                     size_t parent_version = 0);
     
+    // Eliminar una versión que no sea la actual. Las referencias a sus bloques se sueltan
+    // después, con releaseDeferred, cuando la eliminación ya es durable
+    bool removeVersion(const std::string& file_name, size_t version_id);
+    
     // Obtener información de una versión
     const VersionInfo* getVersion(const std::string& file_name, size_t version_id) const;
     
     // Restaurar una versión específica de un archivo
     bool restoreVersion(const std::string& file_name, size_t version_id, std::vector<char>& restored_data);
+
+    // Leer 'length' bytes desde 'offset' de una versión en 'buffer', leyendo solo los bloques
+    // lógicos que cubren el rango. El archivo termina en su último byte no nulo (como en
+    // restoreVersion); 'bytes_read' recibe lo copiado. False si la versión no existe o falla la lectura.
+    bool readRange(const std::string& file_name, size_t version_id, size_t offset, size_t length,
+                   char* buffer, size_t& bytes_read) const;
+
+    // Tamaño de una versión (hasta su último byte no nulo) leyendo solo sus últimos bloques con datos
+    size_t getVersionSize(const std::string& file_name, size_t version_id) const;
     
     // Obtener versión actual de un archivo
     size_t getCurrentVersion(const std::string& file_name) const;
     
     // Guardar todos los metadatos de versiones en disco
     bool saveMetadata(const std::string& metadata_dir);
+
+    // Guardar solo los metadatos de estos archivos y después las versiones actuales de todos.
+    // Cada archivo se reemplaza de forma atómica (temporal + fsync + rename) y current_versions.meta
+    // va el último. Es el punto de control: lo que confirma un cambio es el grupo del registro de
+    // metadatos (ver takeLogRecords), que al arrancar se reproduce sobre estos archivos; el
+    // renombrado de current_versions.meta solo confirma por sí mismo cuando no hay registro.
+    bool saveFiles(const std::string& metadata_dir, const std::vector<std::string>& file_names);
+
+    // saveFiles en tres pasos, para no tener el grafo bloqueado mientras se escribe a disco:
+    // snapshotFiles serializa (con el grafo quieto), writeSnapshot escribe (puede ir en paralelo
+    // con cambios en el grafo, pero no con otro writeSnapshot) y markSaved anota lo guardado
+    struct MetadataSnapshot {
+        std::vector<std::pair<std::string, std::vector<char>>> files; // Nombre -> .meta serializado
+        std::unordered_map<std::string, size_t> versions;            // Contenido de current_versions.meta
+    };
+    MetadataSnapshot snapshotFiles(const std::vector<std::string>& file_names) const;
+    static bool writeSnapshot(const std::string& metadata_dir, const MetadataSnapshot& snapshot);
+    void markSaved(const MetadataSnapshot& snapshot);
     
-    // Cargar todos los metadatos de versiones desde disco
-    bool loadMetadata(const std::string& metadata_dir);
+    // Cargar todos los metadatos de versiones desde disco y, si se pasa 'log', reproducir
+    // después los cambios confirmados en el registro desde el último punto de control
+    bool loadMetadata(const std::string& metadata_dir, MetadataLog* log = nullptr);
+
+    // Registros del WAL con los cambios desde la última llamada (versiones añadidas o
+    // reubicadas, rollbacks y versiones eliminadas); restoreLogRecords los devuelve delante
+    // de los nuevos si no se pudieron escribir
+    std::vector<char> takeLogRecords();
+    void restoreLogRecords(std::vector<char> records);
+
+    // Referencias que soltaron las versiones eliminadas, reemplazadas o reubicadas. No se sueltan
+    // al momento: si el bloque quedara libre (y se perforara o se reutilizara) antes de que el
+    // cambio llegue a disco, tras una caída los metadatos durables apuntarían a él. Quien hace
+    // durables los cambios las toma junto con los registros (takeDeferredReleases), las suelta
+    // después con releaseDeferred (solo toca el BlockManager, así que puede ir sin bloquear el
+    // grafo) o, si no pudo guardar, las devuelve con restoreDeferredReleases
+    std::vector<size_t> takeDeferredReleases();
+    void restoreDeferredReleases(const std::vector<size_t>& releases);
+    void releaseDeferred(const std::vector<size_t>& releases);
     
     // Obtener metadatos de un archivo
     const Metadata* getFileMetadata(const std::string& file_name) const;
@@ -39,7 +89,9 @@ public:
     // Actualizar el tamaño de un archivo en sus metadatos
     void updateFileSize(const std::string& file_name, size_t new_size);
 
-    // Eliminar bloques no referenciados por ninguna versión
+    // Eliminar bloques no referenciados por ninguna versión.
+    // Los contadores de referencias ya liberan los bloques al soltar su última referencia; esto
+    // solo recupera bloques reservados que nunca llegaron a publicarse en una versión.
     void collectGarbage();
 
     // Función para mostrar estadísticas de memoria
@@ -51,9 +103,38 @@ public:
     };
     
     VersionMemoryUsage getVersionMemoryUsage() const;
+
+    // Posición de un bloque físico dentro de una versión de un archivo
+    struct BlockOwner {
+        std::string file_name;
+        size_t version_id;
+        size_t logical_block;  // Índice del bloque dentro de la versión
+        size_t physical_block;
+    };
+
+    // Nombres de todos los archivos del sistema
+    std::vector<std::string> getFileNames() const;
+
+    // Reubicar bloques físicos (viejo -> nuevo) en todas las versiones de todos los archivos
+    // que los usan, trasladando sus referencias. Devuelve el número de entradas cambiadas.
+    // El contenido de cada bloque nuevo debe ser ya idéntico al del viejo. Si se pasa
+    // 'changed_files', recibe los archivos con alguna versión cambiada.
+    size_t relocateBlocks(const std::unordered_map<size_t, size_t>& moves,
+                          std::vector<std::string>* changed_files = nullptr);
+
+    // Todas las versiones (de todos los archivos) que usan alguno de los bloques indicados,
+    // ordenadas por archivo, versión y bloque lógico
+    std::vector<BlockOwner> findBlockOwners(const std::vector<size_t>& physical_blocks) const;
     
 private:
     BlockManager& block_manager;
     std::unordered_map<std::string, Metadata> files_metadata;
     std::unordered_map<std::string, size_t> current_versions;
+    std::unordered_map<std::string, size_t> saved_versions; // Las que hay en current_versions.meta
+    std::vector<char> log_records;                          // Cambios aún no escritos en el WAL
+    std::vector<size_t> deferred_releases;                  // Referencias a soltar cuando sean durables
+
+    void logVersion(const std::string& file_name, const VersionInfo& version, bool make_current);
+    void logChange(uint8_t type, const std::string& file_name, size_t version_id);
+    void applyLogRecord(uint8_t type, const char* payload, size_t size);
 };
\ No newline at end of file
@@ -0,0 +1,145 @@
+// Benchmark de reserva de bloques. Dos partes:
+//  1. Reservas y liberaciones por segundo según el número de hilos escritores, con los grupos de
+//     asignación por defecto y con un solo grupo (todos los hilos compiten por el mismo mutex).
+//     Un hilo aparte llama a sync() sin parar, como haría el vaciado de commits, para que la
+//     escritura del mapa de bits compita con las reservas.
+//  2. Bytes del mapa de bits que hay que escribir en cada sync() tras cambiar N bits sueltos,
+//     frente a copiar enteros los grupos que los contienen.
+#include "AllocationGroups.h"
+#include "BlockManager.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t OPERATIONS_PER_THREAD = 200000;
+constexpr size_t KEPT_PER_THREAD = 64;
+
+void removeStore(const std::string& path) {
+    std::filesystem::remove(path);
+    std::filesystem::remove(path + ".dedup");
+}
+
+// Cada hilo mantiene una pequeña ventana de bloques: reserva uno y libera el más antiguo
+double allocationsPerSecond(size_t threads, size_t allocation_groups, size_t& syncs) {
+    const std::string path = "allocation_bench.bin";
+    removeStore(path);
+    double rate = 0;
+    {
+        StorageOptions options;
+        options.allocation_groups = allocation_groups;
+        // Sin huecos: cada liberación haría un fallocate y se mediría eso y no la reserva
+        options.punch_holes = false;
+        BlockManager manager(path.c_str(), 256 * 1024 * 1024, options);
+
+        std::atomic<bool> stop(false);
+        std::atomic<size_t> sync_count(0);
+        std::thread syncer([&] {
+            while (!stop) {
+                manager.sync();
+                sync_count++;
+            }
+        });
+
+        Clock::time_point start = Clock::now();
+        std::vector<std::thread> writers;
+        for (size_t t = 0; t < threads; t++) {
+            writers.emplace_back([&] {
+                std::vector<size_t> window(KEPT_PER_THREAD, BlockBitmap::npos);
+                for (size_t i = 0; i < OPERATIONS_PER_THREAD; i++) {
+                    size_t& slot = window[i % KEPT_PER_THREAD];
+                    if (slot != BlockBitmap::npos) {
+                        manager.freeBlock(slot);
+                    }
+                    slot = manager.allocateBlock();
+                }
+                for (size_t block : window) {
+                    if (block != BlockBitmap::npos) {
+                        manager.freeBlock(block);
+                    }
+                }
+            });
+        }
+        for (std::thread& writer : writers) {
+            writer.join();
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        stop = true;
+        syncer.join();
+        rate = threads * OPERATIONS_PER_THREAD / seconds;
+        syncs = sync_count;
+    }
+    removeStore(path);
+    return rate;
+}
+
+// Bytes que devuelve takeDirtyWords tras cambiar 'changes' bits al azar en un mapa de 'bits'
+// bloques; en 'group_bytes' los que ocuparían los grupos tocados copiados enteros
+size_t dirtyBytes(size_t bits, size_t group_size, size_t changes, size_t& group_bytes) {
+    AllocationGroups groups;
+    groups.reset(bits, bits, group_size);
+    groups.takeDirtyWords();
+    std::mt19937 random(3);
+    std::vector<bool> touched(bits / group_size + 1);
+    for (size_t i = 0; i < changes; i++) {
+        size_t bit = random() % bits;
+        groups.set(bit);
+        touched[bit / group_size] = true;
+    }
+    group_bytes = 0;
+    for (bool group : touched) {
+        group_bytes += group ? group_size / 8 : 0;
+    }
+    size_t bytes = 0;
+    for (const auto& [first_word, words] : groups.takeDirtyWords()) {
+        bytes += words.size() * sizeof(uint64_t);
+    }
+    return bytes;
+}
+}
+
+int main() {
+    const size_t thread_counts[] = {1, 2, 4, 8};
+
+    std::ostringstream discarded;
+    std::streambuf* console = std::cout.rdbuf(discarded.rdbuf());
+    std::vector<std::pair<double, double>> rates;
+    std::vector<std::pair<size_t, size_t>> syncs;
+    for (size_t threads : thread_counts) {
+        size_t grouped_syncs = 0;
+        size_t single_syncs = 0;
+        double grouped = allocationsPerSecond(threads, StorageOptions().allocation_groups, grouped_syncs);
+        double single = allocationsPerSecond(threads, 1, single_syncs);
+        rates.push_back({grouped, single});
+        syncs.push_back({grouped_syncs, single_syncs});
+    }
+    std::cout.rdbuf(console);
+
+    std::printf("Reservas por segundo (millones), con sync() continuo en otro hilo\n");
+    std::printf("%6s %14s %10s %14s %10s\n", "hilos", "16 grupos", "syncs", "1 grupo", "syncs");
+    for (size_t i = 0; i < std::size(thread_counts); i++) {
+        std::printf("%6zu %14.2f %10zu %14.2f %10zu\n", thread_counts[i], rates[i].first / 1e6, syncs[i].first,
+                    rates[i].second / 1e6, syncs[i].second);
+    }
+
+    // Almacén de 1 GB en bloques de 4 KB repartido en 16 grupos
+    const size_t bits = 256 * 1024;
+    const size_t group_size = bits / 16;
+    std::printf("\nBytes del mapa de bits escritos por sync() (%zu bloques, grupos de %zu)\n", bits, group_size);
+    std::printf("%14s %14s %16s\n", "bits cambiados", "bytes", "grupos enteros");
+    for (size_t changes : {1, 16, 256, 4096}) {
+        size_t group_bytes = 0;
+        size_t bytes = dirtyBytes(bits, group_size, changes, group_bytes);
+        std::printf("%14zu %14zu %16zu\n", changes, bytes, group_bytes);
+    }
+    return 0;
+}
@@ -0,0 +1,232 @@
+// Benchmark del tamaño de bloque. Dos partes:
+//  1. Para cada tamaño habitual, una carga mixta sobre FileSystem (muchos archivos pequeños tipo
+//     configuración y unos pocos grandes tipo multimedia, y después ediciones pequeñas): MB/s de
+//     escritura (hasta sync) y de lectura, y amplificación de espacio = bytes de bloques en uso /
+//     bytes lógicos de los archivos, antes y después de las ediciones (que añaden historial COW).
+//  2. Los bucles por bloque (comparar bloques, recortar ceros finales, mezclar bytes) con el
+//     tamaño como constante de compilación (withBlockSize) y como valor en tiempo de ejecución,
+//     para ver cuánto aporta la especialización.
+#include "BlockManager.h"
+#include "FileSystem.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void removeStore(const std::string& path) {
+    std::filesystem::remove(path);
+    std::filesystem::remove(path + ".dedup");
+    std::filesystem::remove_all(path + "_metadata");
+}
+
+std::vector<char> randomBytes(std::mt19937& random, size_t size) {
+    std::vector<char> data(size);
+    for (char& c : data) {
+        c = static_cast<char>('a' + random() % 26);
+    }
+    return data;
+}
+
+struct WorkloadResult {
+    double write_mb_s;
+    double read_mb_s;
+    double amplification;         // Tras la escritura inicial
+    double amplification_history; // Tras las ediciones, contando las versiones anteriores
+};
+
+constexpr size_t SMALL_FILES = 400;
+constexpr size_t LARGE_FILES = 4;
+constexpr size_t LARGE_FILE_BYTES = 8 * 1024 * 1024;
+constexpr size_t EDITS = 400;
+
+WorkloadResult runWorkload(size_t block_size) {
+    const std::string path = "block_size_bench.bin";
+    removeStore(path);
+    WorkloadResult result{};
+    {
+        StorageOptions options;
+        options.block_size = block_size;
+        FileSystem fs(path, 256, options);
+        std::mt19937 random(7);
+
+        // Contenido de los archivos: pequeños de 200 B a 3 KB y grandes de 8 MB
+        std::vector<std::string> names;
+        std::vector<std::vector<char>> contents;
+        for (size_t i = 0; i < SMALL_FILES; i++) {
+            names.push_back("config" + std::to_string(i));
+            contents.push_back(randomBytes(random, 200 + random() % 2800));
+        }
+        for (size_t i = 0; i < LARGE_FILES; i++) {
+            names.push_back("blob" + std::to_string(i));
+            contents.push_back(randomBytes(random, LARGE_FILE_BYTES));
+        }
+        size_t logical_bytes = 0;
+        for (const auto& content : contents) {
+            logical_bytes += content.size();
+        }
+
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < names.size(); i++) {
+            fs.create(names[i], "bin");
+            fs.open(names[i]);
+            fs.write(names[i], 0, contents[i]);
+        }
+        fs.sync();
+        result.write_mb_s = logical_bytes / 1e6 / secondsSince(start);
+        result.amplification = static_cast<double>(fs.getMemoryUsage().blocks.used_blocks * block_size) / logical_bytes;
+
+        start = Clock::now();
+        size_t read_bytes = 0;
+        std::vector<char> buffer(LARGE_FILE_BYTES);
+        for (size_t i = 0; i < names.size(); i++) {
+            read_bytes += fs.read(names[i], 0, buffer.size(), buffer.data());
+        }
+        result.read_mb_s = read_bytes / 1e6 / secondsSince(start);
+
+        // Ediciones de 100 bytes en sitios al azar: cada una copia el bloque que toca
+        for (size_t e = 0; e < EDITS; e++) {
+            size_t i = random() % names.size();
+            std::vector<char> patch = randomBytes(random, 100);
+            size_t offset = random() % (contents[i].size() - patch.size());
+            fs.write(names[i], offset, patch);
+        }
+        fs.sync();
+        result.amplification_history =
+            static_cast<double>(fs.getMemoryUsage().blocks.used_blocks * block_size) / logical_bytes;
+    }
+    removeStore(path);
+    return result;
+}
+
+// Bucles por bloque tal como los usan FileSystem y VersionGraph. 'Size' es std::integral_constant
+// (especializado) o size_t (genérico); noipa para que el genérico no vea
+// la constante y para que el compilador no saque las llamadas repetidas fuera del bucle
+template <typename Size>
+__attribute__((noipa)) size_t diffBlocks(const char* a, const char* b, size_t blocks, Size block_bytes) {
+    const size_t size = block_bytes;
+    size_t changed = 0;
+    for (size_t i = 0; i < blocks; i++) {
+        changed += std::memcmp(a + i * size, b + i * size, size) != 0;
+    }
+    return changed;
+}
+
+template <typename Size>
+__attribute__((noipa)) size_t trimZeros(const char* data, size_t bytes, Size block_bytes) {
+    const size_t size = block_bytes;
+    size_t end = bytes;
+    while (end >= size && BlockManager::isZeroBlock(data + end - size, size)) {
+        end -= size;
+    }
+    while (end > 0 && data[end - 1] == '\0') {
+        end--;
+    }
+    return end;
+}
+
+template <typename Size>
+__attribute__((noipa)) void mergeBlocks(char* target, const char* source, size_t bytes, size_t offset, Size block_bytes) {
+    const size_t size = block_bytes;
+    size_t copied = 0;
+    size_t first = offset / size;
+    size_t end = (offset + bytes + size - 1) / size;
+    for (size_t logical = first; logical < end; logical++) {
+        size_t begin = logical == first ? offset - first * size : 0;
+        size_t count = std::min(size - begin, bytes - copied);
+        std::memcpy(target + logical * size + begin, source + copied, count);
+        copied += count;
+    }
+}
+
+// GB/s de cada bucle
+struct KernelResult {
+    double diff;
+    double trim;
+    double merge;
+};
+
+template <typename Size>
+KernelResult runKernels(Size block_bytes, const std::vector<char>& a, const std::vector<char>& b,
+                        std::vector<char>& target, size_t repeats) {
+    const size_t size = block_bytes;
+    const size_t blocks = a.size() / size;
+    size_t sink = 0;
+    KernelResult result{};
+
+    Clock::time_point start = Clock::now();
+    for (size_t r = 0; r < repeats; r++) {
+        sink += diffBlocks(a.data(), b.data(), blocks, block_bytes);
+    }
+    result.diff = a.size() * repeats / 1e9 / secondsSince(start);
+
+    start = Clock::now();
+    for (size_t r = 0; r < repeats; r++) {
+        sink += trimZeros(b.data(), b.size(), block_bytes);
+    }
+    result.trim = b.size() * repeats / 1e9 / secondsSince(start);
+
+    start = Clock::now();
+    for (size_t r = 0; r < repeats; r++) {
+        mergeBlocks(target.data(), a.data(), a.size() - size, r % size, block_bytes);
+    }
+    result.merge = a.size() * repeats / 1e9 / secondsSince(start);
+
+    if (sink == 1) {
+        std::cout << "";
+    }
+    return result;
+}
+}
+
+int main(int argc, char** argv) {
+    const size_t sizes[] = {1024, 4096, 16384, 65536};
+
+    std::ostringstream discarded;
+    std::streambuf* console = std::cout.rdbuf(discarded.rdbuf());
+    std::vector<WorkloadResult> workloads;
+    for (size_t block_size : sizes) {
+        workloads.push_back(runWorkload(block_size));
+    }
+    std::cout.rdbuf(console);
+
+    std::printf("Carga mixta: %zu archivos de 200 B - 3 KB, %zu de %zu MB y %zu ediciones de 100 B\n",
+                SMALL_FILES, LARGE_FILES, LARGE_FILE_BYTES >> 20, EDITS);
+    std::printf("%8s %14s %14s %12s %16s\n", "bloque", "escritura MB/s", "lectura MB/s", "amplif.", "amplif. +hist.");
+    for (size_t i = 0; i < std::size(sizes); i++) {
+        std::printf("%7zuK %14.1f %14.1f %12.2f %16.2f\n", sizes[i] / 1024, workloads[i].write_mb_s,
+                    workloads[i].read_mb_s, workloads[i].amplification, workloads[i].amplification_history);
+    }
+
+    // Datos de los bucles: dos copias iguales (la comparación recorre cada bloque entero) con
+    // la mitad final a cero (el recorte salta bloques enteros); la mezcla escribe en un tercero
+    std::mt19937 random(11);
+    std::vector<char> a = randomBytes(random, 64 * 1024 * 1024);
+    std::fill(a.begin() + a.size() / 2, a.end(), '\0');
+    std::vector<char> b = a;
+    std::vector<char> target(a.size());
+    size_t repeats = argc > 1 ? std::stoul(argv[1]) : 20;
+
+    std::printf("\nBucles por bloque, GB/s (constante de compilación / valor en ejecución)\n");
+    std::printf("%8s %22s %22s %22s\n", "bloque", "comparar", "recortar ceros", "mezclar");
+    for (size_t block_size : sizes) {
+        KernelResult fixed = withBlockSize(block_size, [&](auto block_bytes) {
+            return runKernels(block_bytes, a, b, target, repeats);
+        });
+        KernelResult dynamic = runKernels(block_size, a, b, target, repeats);
+        std::printf("%7zuK %9.2f / %-9.2f %9.2f / %-9.2f %9.2f / %-9.2f\n", block_size / 1024, fixed.diff,
+                    dynamic.diff, fixed.trim, dynamic.trim, fixed.merge, dynamic.merge);
+    }
+    return 0;
+}
@@ -9,6 +9,7 @@ extern "C" {
 
 static FileSystem* fs = nullptr;
 static std::string archivo_abierto;
+static std::map<size_t, FileSystem::ReadView> vistas; // Vistas abiertas: sus segmentos deben seguir vivos
 
 void fs_init(const char* path, size_t size_mb) {
     if (fs) delete fs;
@@ -34,18 +35,84 @@ bool write(size_t offset, const char* datos, size_t len) {
     return fs->write(archivo_abierto, offset, buffer);
 }
 
+// Sesión de escritura sobre el archivo abierto: muchas escrituras, una sola versión al confirmar
+size_t beginSession() {
+    if (archivo_abierto.empty()) return 0;
+    return fs->beginSession(archivo_abierto);
+}
+
+bool sessionWrite(size_t session_id, size_t offset, const char* datos, size_t len) {
+    std::vector<char> buffer(datos, datos + len);
+    return fs->sessionWrite(session_id, offset, buffer);
+}
+
+bool commitSession(size_t session_id) {
+    return fs->commitSession(session_id);
+}
+
+void abortSession(size_t session_id) {
+    fs->abortSession(session_id);
+}
+
+// Devuelve un buffer nuevo que el llamador debe liberar con freeRead
 char* read(size_t* out_len) {
+    *out_len = 0;
     if (archivo_abierto.empty()) {
-        *out_len = 0;
         return nullptr;
     }
-    std::vector<char> content = fs->read(archivo_abierto);
-    *out_len = content.size();
-    char* result = new char[content.size()];
-    std::memcpy(result, content.data(), content.size());
+    size_t size = fs->getFileSize(archivo_abierto);
+    char* result = new char[size > 0 ? size : 1];
+    *out_len = fs->read(archivo_abierto, 0, size, result);
     return result;
 }
 
+void freeRead(char* data) {
+    delete[] data;
+}
+
+size_t fileSize() {
+    if (archivo_abierto.empty()) return 0;
+    return fs->getFileSize(archivo_abierto);
+}
+
+// Leer el archivo completo en un buffer del llamador (como mucho capacity bytes)
+size_t readInto(char* buffer, size_t capacity) {
+    if (archivo_abierto.empty()) return 0;
+    return fs->read(archivo_abierto, 0, capacity, buffer);
+}
+
+// Lecturas parciales en un buffer del llamador; devuelven los bytes copiados
+size_t readRange(size_t offset, size_t len, char* buffer) {
+    if (archivo_abierto.empty()) return 0;
+    return fs->read(archivo_abierto, offset, len, buffer);
+}
+
+size_t readVersionRange(size_t version_id, size_t offset, size_t len, char* buffer) {
+    if (archivo_abierto.empty()) return 0;
+    return fs->read(archivo_abierto, offset, len, buffer, version_id);
+}
+
+// Vista del rango: devuelve su identificador (0 si falla) y deja en *segments un array de
+// *count iovec que sigue siendo válido hasta releaseView. El almacén del puente usa el backend
+// de descriptor, así que la vista copia los bloques a un buffer propio (ver FileSystem::openView)
+size_t openView(size_t offset, size_t len, const struct iovec** segments, size_t* count) {
+    *segments = nullptr;
+    *count = 0;
+    if (archivo_abierto.empty()) return 0;
+    FileSystem::ReadView view = fs->openView(archivo_abierto, offset, len);
+    if (view.id == 0) return 0;
+    FileSystem::ReadView& stored = vistas[view.id] = std::move(view);
+    *segments = stored.segments.data();
+    *count = stored.segments.size();
+    return stored.id;
+}
+
+void releaseView(size_t view_id) {
+    if (vistas.erase(view_id) > 0) {
+        fs->releaseView(view_id);
+    }
+}
+
 bool rollback(size_t version_id) {
     if (archivo_abierto.empty()) return false;
     return fs->rollbackFile(archivo_abierto, version_id);
@@ -72,12 +139,29 @@ void sync() {
     fs->sync();
 }
 
+// Modo de durabilidad: 0 = inmediato, 1 = escritura agrupada, 2 = bajo demanda. Cualquier otro
+// valor se rechaza (devuelve false y no cambia nada) en lugar de acabar tratado como bajo demanda
+bool setDurability(int mode, size_t interval_ms, size_t ops) {
+    if (mode < 0 || mode > 2) return false;
+    FileSystem::DurabilityOptions options;
+    options.mode = static_cast<FileSystem::DurabilityMode>(mode);
+    options.group_interval_ms = interval_ms;
+    options.group_ops = ops;
+    fs->setDurability(options);
+    return true;
+}
+
+bool barrier() {
+    return fs->barrier();
+}
+
 void printMemoryUsage() {
     fs->printMemoryUsage();
 }
 
 void fs_destroy() {
     if (fs) {
+        vistas.clear();
         delete fs;
         fs = nullptr;
         archivo_abierto.clear();
@@ -0,0 +1,259 @@
+// Prueba de concurrencia: varios hilos reservan, escriben, leen y liberan bloques a la vez
+// sobre el mismo BlockManager, y escriben y leen versiones de archivos a la vez sobre el mismo
+// FileSystem. Cada lectura se compara con lo que se escribió. Devuelve 0 si todo coincide.
+#include "BlockManager.h"
+#include "FileSystem.h"
+#include <atomic>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+constexpr size_t WRITERS = 4;
+constexpr size_t READERS = 4;
+constexpr size_t PUBLISHED_BLOCKS = 256;
+constexpr size_t WRITES_PER_THREAD = 2000;
+constexpr size_t FILE_WRITES_PER_THREAD = 150;
+
+std::atomic<size_t> failures(0);
+
+void fail(const std::string& message) {
+    if (failures++ < 10) {
+        std::cerr << "FALLO: " << message << "\n";
+    }
+}
+
+// Contenido determinista de un bloque: depende del bloque y de la generación que lo escribió
+void fillPattern(char* data, size_t size, size_t block, size_t generation) {
+    for (size_t i = 0; i < size; i++) {
+        data[i] = static_cast<char>((block * 31 + generation * 7 + i) & 0xFF);
+    }
+}
+
+bool matchesPattern(const char* data, size_t size, size_t block, size_t generation) {
+    for (size_t i = 0; i < size; i++) {
+        if (data[i] != static_cast<char>((block * 31 + generation * 7 + i) & 0xFF)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void removeStore(const std::string& path) {
+    std::filesystem::remove(path);
+    std::filesystem::remove(path + ".dedup");
+    std::filesystem::remove_all(path + "_metadata");
+}
+
+// Bloques: los lectores releen sin parar un conjunto de bloques ya publicados (uno a uno y en
+// lotes) mientras los escritores reservan, escriben, comprueban y liberan otros. Un bloque no
+// puede entregarse a dos hilos a la vez: cada reserva marca su dueño y falla si ya tenía uno.
+void hammerBlocks(const std::string& name, StorageOptions options) {
+    const std::string path = "concurrency_test_blocks.bin";
+    removeStore(path);
+    {
+        BlockManager manager(path.c_str(), 64 * 1024 * 1024, options);
+        const size_t block_size = manager.getBlockSize();
+        std::vector<std::atomic<uint8_t>> owned(manager.getMaxBlocks());
+
+        std::vector<size_t> published;
+        std::vector<char> data(block_size);
+        for (size_t i = 0; i < PUBLISHED_BLOCKS; i++) {
+            size_t block = manager.allocateBlock();
+            owned[block] = 1;
+            fillPattern(data.data(), block_size, block, 0);
+            manager.writeBlock(block, data.data(), block_size);
+            published.push_back(block);
+        }
+
+        std::atomic<bool> stop(false);
+        std::vector<std::thread> threads;
+        for (size_t r = 0; r < READERS; r++) {
+            threads.emplace_back([&, r] {
+                std::mt19937 random(static_cast<unsigned>(r));
+                std::vector<char> buffer(block_size * 8);
+                while (!stop) {
+                    size_t block = published[random() % published.size()];
+                    manager.readBlock(block, buffer.data(), block_size);
+                    if (!matchesPattern(buffer.data(), block_size, block, 0)) {
+                        fail(name + ": lectura de un bloque publicado");
+                    }
+                    std::vector<size_t> batch;
+                    for (size_t i = 0; i < 8; i++) {
+                        batch.push_back(published[random() % published.size()]);
+                    }
+                    manager.readBlocks(batch, buffer.data());
+                    for (size_t i = 0; i < batch.size(); i++) {
+                        if (!matchesPattern(buffer.data() + i * block_size, block_size, batch[i], 0)) {
+                            fail(name + ": lectura en lote de bloques publicados");
+                        }
+                    }
+                }
+            });
+        }
+        for (size_t w = 0; w < WRITERS; w++) {
+            threads.emplace_back([&, w] {
+                std::vector<char> buffer(block_size);
+                std::vector<char> check(block_size);
+                std::vector<size_t> kept;
+                for (size_t i = 0; i < WRITES_PER_THREAD; i++) {
+                    size_t generation = (w + 1) * WRITES_PER_THREAD + i;
+                    size_t block = manager.allocateBlock();
+                    if (block == BlockBitmap::npos) {
+                        fail(name + ": almacén lleno");
+                        break;
+                    }
+                    if (owned[block].exchange(1) != 0) {
+                        fail(name + ": bloque " + std::to_string(block) + " entregado a dos hilos");
+                    }
+                    fillPattern(buffer.data(), block_size, block, generation);
+                    manager.writeBlock(block, buffer.data(), block_size);
+                    manager.readBlock(block, check.data(), block_size);
+                    if (!matchesPattern(check.data(), block_size, block, generation)) {
+                        fail(name + ": releer un bloque recién escrito");
+                    }
+                    // La mitad se libera enseguida para que las reservas reutilicen huecos
+                    if (i % 2 == 0) {
+                        owned[block] = 0;
+                        manager.freeBlock(block);
+                    } else {
+                        kept.push_back(block);
+                    }
+                }
+                for (size_t block : kept) {
+                    owned[block] = 0;
+                    manager.freeBlock(block);
+                }
+            });
+        }
+        for (size_t w = 0; w < WRITERS; w++) {
+            threads[READERS + w].join();
+        }
+        stop = true;
+        for (size_t r = 0; r < READERS; r++) {
+            threads[r].join();
+        }
+
+        // Con compresión, los huecos que guardan los bloques empaquetados también están en uso
+        BlockManager::MemoryUsage usage = manager.getMemoryUsage();
+        size_t used = usage.used_blocks - usage.pack_slots;
+        if (used != PUBLISHED_BLOCKS) {
+            fail(name + ": quedan " + std::to_string(used) + " bloques en uso, se esperaban " +
+                 std::to_string(PUBLISHED_BLOCKS));
+        }
+    }
+    removeStore(path);
+}
+
+// Archivos: un escritor por archivo publica versiones mientras los lectores leen versiones ya
+// publicadas de cualquier archivo, y cada lectura debe coincidir con lo que tenía esa versión
+void hammerFiles(const std::string& name, StorageOptions options) {
+    const std::string path = "concurrency_test_files.bin";
+    removeStore(path);
+    {
+        FileSystem fs(path, 64, options);
+        std::mutex expected_mutex;
+        std::vector<std::pair<std::string, size_t>> published;
+        std::map<std::pair<std::string, size_t>, std::vector<char>> expected;
+
+        std::vector<std::string> files;
+        for (size_t w = 0; w < WRITERS; w++) {
+            files.push_back("archivo" + std::to_string(w));
+            fs.create(files.back(), "bin");
+            fs.open(files.back());
+            expected[{files.back(), fs.getCurrentVersion(files.back())}] = {};
+            published.emplace_back(files.back(), fs.getCurrentVersion(files.back()));
+        }
+
+        std::atomic<bool> stop(false);
+        std::vector<std::thread> threads;
+        for (size_t r = 0; r < READERS; r++) {
+            threads.emplace_back([&, r] {
+                std::mt19937 random(static_cast<unsigned>(100 + r));
+                while (!stop) {
+                    std::pair<std::string, size_t> key;
+                    std::vector<char> content;
+                    {
+                        std::lock_guard<std::mutex> lock(expected_mutex);
+                        key = published[random() % published.size()];
+                        content = expected[key];
+                    }
+                    std::vector<char> buffer(content.size() + 1);
+                    size_t read = fs.read(key.first, 0, buffer.size(), buffer.data(), key.second);
+                    if (read != content.size() || !std::equal(content.begin(), content.end(), buffer.begin())) {
+                        fail(name + ": lectura de " + key.first + " v" + std::to_string(key.second));
+                    }
+                }
+            });
+        }
+        for (size_t w = 0; w < WRITERS; w++) {
+            threads.emplace_back([&, w] {
+                std::mt19937 random(static_cast<unsigned>(200 + w));
+                const std::string& file = files[w];
+                std::vector<char> content;
+                for (size_t i = 0; i < FILE_WRITES_PER_THREAD; i++) {
+                    size_t offset = random() % (64 * 1024);
+                    std::vector<char> data(1 + random() % 9000);
+                    for (char& c : data) {
+                        c = static_cast<char>('a' + random() % 26);
+                    }
+                    if (!fs.write(file, offset, data)) {
+                        fail(name + ": escritura en " + file);
+                        continue;
+                    }
+                    if (content.size() < offset + data.size()) {
+                        content.resize(offset + data.size(), '\0');
+                    }
+                    std::copy(data.begin(), data.end(), content.begin() + offset);
+                    std::lock_guard<std::mutex> lock(expected_mutex);
+                    size_t version = fs.getCurrentVersion(file);
+                    expected[{file, version}] = content;
+                    published.emplace_back(file, version);
+                }
+            });
+        }
+        for (size_t w = 0; w < WRITERS; w++) {
+            threads[READERS + w].join();
+        }
+        stop = true;
+        for (size_t r = 0; r < READERS; r++) {
+            threads[r].join();
+        }
+    }
+    removeStore(path);
+}
+}
+
+int main() {
+    // FileSystem informa de cada operación por la salida estándar; aquí solo importan los fallos
+    std::ostringstream discarded;
+    std::streambuf* console = std::cout.rdbuf(discarded.rdbuf());
+
+    StorageOptions descriptor;
+    StorageOptions mapped;
+    mapped.backend = StorageBackend::MemoryMapped;
+    StorageOptions packed;
+    packed.compression = true;
+    packed.dedup = true;
+
+    hammerBlocks("bloques (descriptor)", descriptor);
+    hammerBlocks("bloques (mmap)", mapped);
+    hammerBlocks("bloques (compresión y deduplicación)", packed);
+    hammerFiles("archivos (descriptor)", descriptor);
+    hammerFiles("archivos (mmap)", mapped);
+    hammerFiles("archivos (compresión y deduplicación)", packed);
+
+    std::cout.rdbuf(console);
+    if (failures > 0) {
+        std::cout << "concurrency_test: " << failures << " fallos\n";
+        return 1;
+    }
+    std::cout << "concurrency_test: OK\n";
+    return 0;
+}